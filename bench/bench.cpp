@@ -0,0 +1,586 @@
+/*
+ * DataPoint for C++ (benchmarks)
+ *
+ * Offline microbenchmarks for the hot paths: JSON parse, nearest site resolution, gridded interpolation,
+ * forecast decoding and observation decoding. Everything runs against the recorded responses in bench/fixtures, so no API key or
+ * network is needed. Each case reports time and allocations per operation, plus throughput where there's a
+ * payload to measure it against.
+ *
+ * The steady/ cases also check the workspace's promise: once warmed up, repeated calls make no allocations.
+ * The check/ cases run the client against a stand-in Datapoint on a loopback port. The bench exits with 1 if any
+ * of these fail.
+ *
+ * Build from the repository root, e.g.
+ *   g++ -std=c++17 -O2 -I. bench/bench.cpp datapoint/[a-z]*.cpp -lcurl -pthread -o datapoint-bench
+ *   ./datapoint-bench [fixtures directory] [case name filter]
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
+
+#include "datapoint/datapoint.h"
+#include "datapoint/stream.h"
+
+using namespace std;
+
+#define BENCH_MIN_SECONDS 0.25 //Each case repeats until it's run at least this long
+#define BENCH_SITES 6000 //Roughly the size of the real forecast sitelist
+#define BENCH_QUERIES 1024
+#define BENCH_STEADY_CYCLES 64 //Calls counted by the zero allocation check, after warm up
+#define BENCH_BUFFER 40 //Forecasts, more than a 3 hourly response holds
+#define BENCH_REUSE_CYCLES 16 //Rounds of the three request routes on one api object
+#define BENCH_THREADS 8 //api objects calling GetForecasts at once
+#define BENCH_THREAD_CALLS 32 //Each
+
+/*
+ * Every allocation in the process goes through here, so a case's allocations are the difference in the
+ * counter across its loop.
+ */
+static atomic<unsigned long long> allocations(0);
+
+void * operator new(size_t size) {
+	allocations++;
+	if (void *ptr = malloc(size ? size : 1)) { return ptr; }
+	throw bad_alloc();
+}
+void * operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+static volatile size_t sink; //Results go here so the optimiser can't throw the work away
+static string filter;
+
+static bool Wanted(const char *name) {
+	return filter == "" || strstr(name, filter.c_str()) != NULL;
+}
+
+template <class F> static void Run(const char *name, size_t bytes, F op) {
+	if (!Wanted(name)) { return; }
+	op(); //Warm up, fills caches and lets anything lazy happen outside the timing
+
+	unsigned long long iterations = 0;
+	unsigned long long startAllocs = allocations;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	double elapsed = 0;
+	while (elapsed < BENCH_MIN_SECONDS) {
+		for (int i = 0; i < 16; i++) { op(); }
+		iterations += 16;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+	double allocsPerOp = (double)(allocations - startAllocs) / iterations;
+	double nsPerOp = elapsed * 1e9 / iterations;
+
+	printf("%-40s %12.0f ns/op %10.1f allocs/op", name, nsPerOp, allocsPerOp);
+	if (bytes) { printf(" %10.1f MB/s", bytes / (nsPerOp / 1e9) / 1e6); }
+	printf("\n");
+}
+
+static string Load(const string &dir, const char *name) {
+	ifstream in(dir + "/" + name, ios_base::in | ios_base::binary);
+	if (!in) {
+		printf("Missing fixture %s/%s\n", dir.c_str(), name);
+		exit(1);
+	}
+	ostringstream body;
+	body << in.rdbuf();
+	return body.str();
+}
+
+/*
+ * Lays a response out where a file:// base URL will find it, e.g. root/wxfcs/all/json/310042. cURL ignores the
+ * query string on files, so the api's own URLs work unchanged.
+ */
+static void Serve(const string &root, const string &path, const string &id, const string &body, vector<string> &made) {
+	for (size_t slash = path.find('/'); ; slash = path.find('/', slash + 1)) {
+		string dir = root + "/" + path.substr(0, slash);
+		if (mkdir(dir.c_str(), 0700) == 0) { made.push_back(dir); }
+		if (slash == string::npos) { break; }
+	}
+	made.push_back(root + "/" + path + "/" + id);
+	ofstream out(made.back(), ios_base::out | ios_base::binary | ios_base::trunc);
+	out << body;
+}
+
+static void Parse(rapidjson::Document &json, const string &body) {
+	if (json.Parse(body.c_str()).HasParseError()) {
+		printf("Fixture doesn't parse\n");
+		exit(1);
+	}
+}
+
+/*
+ * The sitelist fixture is a few hundred sites. Copies with their co-ords nudged make it up to the size of the
+ * real list so the nearest site numbers mean something.
+ */
+static vector<datapoint::site> Scale(const datapoint::siteindex &recorded, size_t want) {
+	vector<datapoint::site> sites;
+	mt19937 random(2019);
+	uniform_real_distribution<float> nudge(-0.05, 0.05);
+	for (size_t i = 0; sites.size() < want; i++) {
+		datapoint::site s = recorded[i % recorded.Size()];
+		if (i >= recorded.Size()) {
+			s.id += 1000000 * (i / recorded.Size());
+			s.lat += nudge(random);
+			s.lon += nudge(random);
+		}
+		sites.push_back(s);
+	}
+	return sites;
+}
+
+static bool Same(const vector<datapoint::forecast> &a, const vector<datapoint::forecast> &b) {
+	if (a.size() != b.size()) { return false; }
+	for (size_t i = 0; i < a.size(); i++) {
+		const datapoint::forecast &x = a[i], &y = b[i];
+		if (x.feelsLike != y.feelsLike || x.windGust != y.windGust || x.humidity != y.humidity || x.temperature != y.temperature
+				|| x.visibility != y.visibility || x.windDirection != y.windDirection || x.windSpeed != y.windSpeed || x.uv != y.uv
+				|| x.weatherType != y.weatherType || x.precipitationProb != y.precipitationProb || x.minsofday != y.minsofday
+				|| x.date != y.date) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * A stand-in Datapoint on a loopback port, for the checks that need real HTTP. Like mock/mockserver.cpp it keeps
+ * connections alive, but it runs in process, picks a free port and counts the connections it accepts. Each
+ * request gets the body of the first route whose fragment is in its path, or a 404.
+ */
+class standin {
+	private:
+		int listener;
+		vector<pair<string, string> > routes;
+		thread loop;
+		mutex open_lock;
+		vector<int> open;
+		vector<thread> serving;
+		void Accept() {
+			while (true) {
+				int fd = accept(listener, NULL, NULL);
+				if (fd < 0) { return; } //Shut down
+				connections++;
+				lock_guard<mutex> guard(open_lock);
+				open.push_back(fd);
+				serving.emplace_back(&standin::Serve, this, fd);
+			}
+		}
+		void Serve(int fd) {
+			string pending;
+			char buffer[4096];
+			while (true) {
+				size_t end;
+				while ((end = pending.find("\r\n\r\n")) == string::npos) {
+					ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+					if (got <= 0) { return; } //Closed by the client or the destructor
+					pending.append(buffer, got);
+				}
+				istringstream line(pending.substr(0, end));
+				pending.erase(0, end + 4);
+				string method, path;
+				line >> method >> path;
+				requests++;
+
+				string status = "404 Not Found", body;
+				for (const pair<string, string> &route : routes) {
+					if (path.find(route.first) != string::npos) {
+						status = "200 OK";
+						body = route.second;
+						break;
+					}
+				}
+				string reply = "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nContent-Length: "
+						+ to_string(body.size()) + "\r\nConnection: keep-alive\r\n\r\n" + body;
+				for (size_t sent = 0; sent < reply.size(); ) {
+					ssize_t wrote = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+					if (wrote <= 0) { return; }
+					sent += wrote;
+				}
+			}
+		}
+	public:
+		atomic<unsigned int> connections, requests;
+		int port = 0;
+		explicit standin(vector<pair<string, string> > inroutes) : routes(inroutes), connections(0), requests(0) {
+			listener = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = 0; //Any free port
+			socklen_t length = sizeof(address);
+			if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0
+					|| getsockname(listener, (sockaddr*)&address, &length) != 0) {
+				printf("Can't listen on a loopback port for the stand-in server\n");
+				exit(1);
+			}
+			port = ntohs(address.sin_port);
+			loop = thread(&standin::Accept, this);
+		}
+		~standin() {
+			shutdown(listener, SHUT_RDWR); //Wakes accept
+			loop.join();
+			close(listener);
+			lock_guard<mutex> guard(open_lock);
+			for (int fd : open) { shutdown(fd, SHUT_RDWR); } //Wakes recv on connections the client still holds open
+			for (thread &t : serving) { t.join(); }
+			for (int fd : open) { close(fd); }
+		}
+		string Url() const { return "http://127.0.0.1:" + to_string(port) + "/public/data/val"; }
+} ;
+
+int main(int argc, char *argv[]) {
+	string dir = (argc > 1) ? argv[1] : "bench/fixtures";
+	if (argc > 2) { filter = argv[2]; }
+
+	const char *fixtures[] = {
+		"sitelist_forecast.json", "sitelist_observation.json",
+		"forecast_3hourly.json", "forecast_3hourly_midnight.json", "forecast_daily.json",
+		"observation_hourly.json", "observation_hourly_before_midnight.json", "observation_hourly_after_midnight.json"
+	};
+	vector<string> bodies;
+	for (const char *name : fixtures) { bodies.push_back(Load(dir, name)); }
+
+	datapoint::api weather;
+	vector<rapidjson::Document> parsed(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++) { Parse(parsed[i], bodies[i]); }
+
+	/*
+	 * JSON parse, DOM and streaming.
+	 */
+	for (size_t i = 0; i < bodies.size(); i++) {
+		string name = string("parse/dom/") + fixtures[i];
+		Run(name.c_str(), bodies[i].size(), [&]() {
+			rapidjson::Document json;
+			Parse(json, bodies[i]);
+			sink = json.IsObject();
+		});
+	}
+	Run("parse/stream/sitelist_forecast.json", bodies[0].size(), [&]() {
+		datapoint::sitelisthandler handler;
+		rapidjson::StringStream stream(bodies[0].c_str());
+		rapidjson::Reader reader;
+		reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, handler);
+		sink = handler.sites.size();
+	});
+	Run("parse/stream/forecast_3hourly.json", bodies[2].size(), [&]() {
+		vector<datapoint::forecast> frcst;
+		datapoint::forecasthandler handler(&frcst);
+		rapidjson::StringStream stream(bodies[2].c_str());
+		rapidjson::Reader reader;
+		reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, handler);
+		sink = frcst.size();
+	});
+
+	/*
+	 * Nearest site. The linear scan is how sites were found before the index, kept as the baseline.
+	 */
+	const rapidjson::Document &sitelist = parsed[0];
+	datapoint::siteindex recorded;
+	recorded.Build(sitelist);
+	vector<datapoint::site> scaled = Scale(recorded, BENCH_SITES);
+	datapoint::siteindex index;
+	index.Build(scaled);
+
+	Run("nearest/index-build/6000", 0, [&]() {
+		datapoint::siteindex built;
+		built.Build(scaled);
+		sink = built.Size();
+	});
+	Run("nearest/index-build/sitelist_forecast.json", bodies[0].size(), [&]() {
+		datapoint::siteindex built;
+		built.Build(sitelist);
+		sink = built.Size();
+	});
+
+	vector<datapoint::coords> queries;
+	mt19937 random(7);
+	uniform_real_distribution<double> lat(49.9, 60.8), lon(-8.2, 1.8);
+	for (size_t i = 0; i < BENCH_QUERIES; i++) { queries.push_back({ lat(random), lon(random) }); }
+	size_t q = 0;
+
+	Run("nearest/linear/6000", 0, [&]() {
+		const datapoint::coords &c = queries[q++ % BENCH_QUERIES];
+		const datapoint::site *nearest = &scaled[0];
+		double best = datapoint::siteindex::Kilometres(*nearest, c.lat, c.lon);
+		for (const datapoint::site &s : scaled) {
+			double dist = datapoint::siteindex::Kilometres(s, c.lat, c.lon);
+			if (dist < best) { best = dist; nearest = &s; }
+		}
+		sink = nearest->id;
+	});
+	Run("nearest/kdtree/6000", 0, [&]() {
+		const datapoint::coords &c = queries[q++ % BENCH_QUERIES];
+		sink = index.Nearest(c.lat, c.lon)->id;
+	});
+	Run("nearest/kdtree-k8/6000", 0, [&]() {
+		const datapoint::coords &c = queries[q++ % BENCH_QUERIES];
+		sink = index.Nearest(c.lat, c.lon, 8).size();
+	});
+
+	/*
+	 * Many points at once. Distances to every site through the structure of arrays kernel, and a map tile of
+	 * inverse distance weighted values.
+	 */
+	datapoint::sitegrid grid(index);
+	vector<float> km(grid.Size()), values(grid.Size());
+	uniform_real_distribution<float> temperature(-5, 25);
+	for (float &v : values) { v = temperature(random); }
+	Run("nearest/distances-soa/6000", 0, [&]() {
+		const datapoint::coords &c = queries[q++ % BENCH_QUERIES];
+		grid.Distances(c.lat, c.lon, km.data());
+		sink = km[0];
+	});
+	datapoint::gridspec tile;
+	tile.lat = 53.0; tile.lon = 0.5; tile.latStep = -0.005; tile.lonStep = 0.008; tile.rows = 256; tile.cols = 256;
+	vector<float> pixels(tile.size());
+	Run("grid/idw-k4/256x256", 0, [&]() {
+		grid.Interpolate(tile, values.data(), pixels.data(), 4);
+		sink = pixels[0];
+	});
+
+	/*
+	 * Decoding from an already parsed DOM.
+	 */
+	for (size_t i = 2; i <= 4; i++) {
+		const rapidjson::Document *json = &parsed[i];
+		string name = string("decode/forecast/") + fixtures[i];
+		Run(name.c_str(), 0, [&, json]() {
+			sink = weather.DecodeForecast(*json).size();
+		});
+		name = string("decode/forecast-typed/") + fixtures[i];
+		Run(name.c_str(), 0, [&, json]() {
+			datapoint::forecastseries series;
+			series.Decode(*json);
+			sink = series.size();
+		});
+	}
+	for (size_t i = 5; i <= 7; i++) {
+		const rapidjson::Document *json = &parsed[i];
+		string name = string("decode/observation/") + fixtures[i];
+		Run(name.c_str(), 0, [&, json]() {
+			sink = weather.DecodeObservation(*json).weatherType;
+		});
+		name = string("decode/observation-typed/") + fixtures[i];
+		Run(name.c_str(), 0, [&, json]() {
+			datapoint::observationseries series;
+			series.Decode(*json);
+			sink = series.size();
+		});
+	}
+
+	/*
+	 * Export, decoded and formatted into the exporter's buffer and written to /dev/null. The stream case is the
+	 * route ExportAllForecasts takes, parsing the raw body rather than starting from a DOM.
+	 */
+	FILE *discard = fopen("/dev/null", "wb");
+	datapoint::exporter ndjson(discard, datapoint::exporter::NDJSON), csv(discard, datapoint::exporter::CSV);
+	Run("export/ndjson/forecast_3hourly.json", 0, [&]() {
+		sink = ndjson.Forecasts(parsed[2]);
+		ndjson.Flush();
+	});
+	Run("export/ndjson-stream/forecast_3hourly.json", bodies[2].size(), [&]() {
+		datapoint::exporthandler<datapoint::forecastrecord> handler(&ndjson);
+		rapidjson::StringStream stream(bodies[2].c_str());
+		rapidjson::Reader reader;
+		reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, handler);
+		sink = handler.rows;
+		ndjson.Flush();
+	});
+	Run("export/csv/forecast_3hourly.json", 0, [&]() {
+		sink = csv.Forecasts(parsed[2]);
+		csv.Flush();
+	});
+	Run("export/ndjson/observation_hourly.json", 0, [&]() {
+		sink = ndjson.Observations(parsed[5]);
+		ndjson.Flush();
+	});
+
+	/*
+	 * Connection reuse. One api object goes through all three ways a forecast is fetched: Call (with a header
+	 * callback), Stream and the workspace Call. Every request should ride the one kept-alive connection, and none
+	 * should trip over callbacks or userdata left on the pooled handle by the route before it.
+	 */
+	unsigned int failed = 0;
+	if (Wanted("check/connection-reuse")) {
+		standin server({ { "/wxfcs/", bodies[2] } });
+		unsigned int calls = 0;
+		bool ok = true;
+		{
+			datapoint::api reuse;
+			reuse.Setkey("bench");
+			reuse.Seturl(server.Url());
+			reuse.Setpool(make_shared<datapoint::connectionpool>()); //Nothing open from earlier cases
+			reuse.Setscheduler(make_shared<datapoint::scheduler>(0));
+			reuse.forecast_id = stoul(parsed[2]["SiteRep"]["DV"]["Location"]["i"].GetString());
+			vector<datapoint::forecast> buffer(BENCH_BUFFER);
+			try {
+				for (int i = 0; i < BENCH_REUSE_CYCLES; i++) {
+					reuse.Setworkspace(false);
+					reuse.Setstreaming(false);
+					ok = ok && !reuse.GetForecasts().empty();
+					reuse.Setstreaming(true);
+					ok = ok && !reuse.GetForecasts().empty();
+					reuse.Setworkspace(true);
+					ok = ok && reuse.GetForecast(buffer.data(), buffer.size()) > 0;
+					calls += 3;
+				}
+			} catch (...) {
+				ok = false;
+			}
+		} //The pool goes with the api object, closing its connection
+		ok = ok && server.requests == calls && server.connections == 1;
+		printf("%-40s %12s %10u requests on %u connections\n", "check/connection-reuse", (ok) ? "ok" : "FAIL",
+				(unsigned int)server.requests, (unsigned int)server.connections);
+		failed += !ok;
+	}
+
+	/*
+	 * Reentrancy. Several threads, each with its own api object, look up a location in one shared sitelist
+	 * index and call GetForecasts at once through one shared pool and scheduler. Two sites far apart get
+	 * different bodies, and half the threads stream while the rest parse a DOM, so anything shared by mistake
+	 * shows up as a wrong answer. Results are checked as they arrive, then again once every thread is done, to
+	 * show each caller owns what it was given.
+	 */
+	if (Wanted("check/reentrant-getforecasts")) {
+		shared_ptr<const datapoint::siteindex> sites = make_shared<datapoint::siteindex>(recorded);
+		const datapoint::site *where[] = { sites->Nearest((*sites)[0].lat, (*sites)[0].lon),
+				sites->Nearest((*sites)[sites->Size() / 2].lat, (*sites)[sites->Size() / 2].lon) };
+		standin server({ { "/" + to_string(where[0]->id) + "?", bodies[2] },
+				{ "/" + to_string(where[1]->id) + "?", bodies[3] } });
+		shared_ptr<datapoint::connectionpool> pool = make_shared<datapoint::connectionpool>();
+		shared_ptr<datapoint::scheduler> queue = make_shared<datapoint::scheduler>(0);
+		auto setup = [&](datapoint::api &client, int site, bool streamed) {
+			client.Setkey("bench");
+			client.Seturl(server.Url());
+			client.Setpool(pool);
+			client.Setscheduler(queue);
+			client.Setstreaming(streamed);
+			client.Setsites(sites, true);
+			client.Setlocation(where[site]->lat, where[site]->lon);
+		};
+
+		vector<datapoint::forecast> expected[2][2]; //By site, then streamed, fetched one at a time first
+		bool ok = where[0]->id != where[1]->id;
+		try {
+			for (int site = 0; site < 2; site++) {
+				for (int streamed = 0; streamed < 2; streamed++) {
+					datapoint::api client;
+					setup(client, site, streamed);
+					expected[site][streamed] = client.GetForecasts();
+				}
+			}
+		} catch (...) {
+			ok = false;
+		}
+		ok = ok && !expected[0][0].empty() && !Same(expected[0][0], expected[1][0]);
+
+		vector<vector<vector<datapoint::forecast> > > kept(BENCH_THREADS);
+		atomic<unsigned int> wrong(0);
+		vector<thread> threads;
+		for (int t = 0; ok && t < BENCH_THREADS; t++) {
+			threads.emplace_back([&, t]() {
+				int site = t % 2, streamed = (t / 2) % 2;
+				datapoint::api client;
+				setup(client, site, streamed);
+				try {
+					for (int i = 0; i < BENCH_THREAD_CALLS; i++) {
+						kept[t].push_back(client.GetForecasts());
+						if (!Same(kept[t].back(), expected[site][streamed])) { wrong++; }
+					}
+					if (client.forecast_id != where[site]->id) { wrong++; } //Resolved through the shared index
+				} catch (...) {
+					wrong++;
+				}
+			});
+		}
+		for (thread &t : threads) { t.join(); }
+		unsigned int results = 0;
+		for (int t = 0; ok && t < BENCH_THREADS; t++) {
+			for (const vector<datapoint::forecast> &got : kept[t]) {
+				if (!Same(got, expected[t % 2][(t / 2) % 2])) { wrong++; }
+				results++;
+			}
+		}
+		ok = ok && wrong == 0 && results == (unsigned int)(BENCH_THREADS * BENCH_THREAD_CALLS);
+		printf("%-40s %12s %10u results from %d threads, %u wrong\n", "check/reentrant-getforecasts", (ok) ? "ok" : "FAIL",
+				results, BENCH_THREADS, (unsigned int)wrong);
+		failed += !ok;
+	}
+
+	/*
+	 * Steady state. An api object with a workspace refetches one forecast and one observation site over and over
+	 * from file:// copies of the fixtures, through cURL, the arena parse and every decode that uses the
+	 * workspace. There's no fair use limit on local files, so the scheduler is given no rate. cURL's own
+	 * allocations are C mallocs and aren't counted.
+	 */
+	char root[] = "/tmp/datapoint-bench-XXXXXX";
+	if (filter != "" && filter.compare(0, 6, "steady") != 0) { return (failed) ? 1 : 0; }
+	if (!mkdtemp(root)) {
+		printf("Can't make a directory for the steady state fixtures\n");
+		return 1;
+	}
+	string forecastId = parsed[2]["SiteRep"]["DV"]["Location"]["i"].GetString();
+	string observationId = parsed[5]["SiteRep"]["DV"]["Location"]["i"].GetString();
+	vector<string> made;
+	Serve(root, "wxfcs/all/json", forecastId, bodies[2], made);
+	Serve(root, "wxobs/all/json", observationId, bodies[5], made);
+
+	datapoint::api steady;
+	steady.Setkey("bench");
+	steady.Seturl(string("file://") + root);
+	steady.Setscheduler(make_shared<datapoint::scheduler>(0));
+	steady.Setworkspace(true);
+	steady.forecast_id = stoul(forecastId);
+	steady.observation_id = stoul(observationId);
+	datapoint::forecastseries forecasts;
+	datapoint::observationseries observations;
+	datapoint::observationhistory history;
+	vector<datapoint::forecast> buffer(BENCH_BUFFER);
+	auto cycle = [&]() {
+		forecasts.clear();
+		steady.GetForecast(forecasts);
+		observations.clear();
+		steady.GetObservation(observations);
+		history.clear();
+		steady.GetObservation(history);
+		sink = steady.GetForecast(buffer.data(), buffer.size()) + steady.GetObservation().weatherType;
+	};
+	Run("steady/workspace/4-calls", 0, cycle);
+
+	unsigned long long before = allocations;
+	for (int i = 0; i < BENCH_STEADY_CYCLES; i++) { cycle(); }
+	unsigned long long extra = allocations - before;
+	printf("%-40s %12s %10llu allocs in %d cycles\n", "steady/zero-allocation-check", (extra) ? "FAIL" : "ok", extra, BENCH_STEADY_CYCLES);
+
+	for (vector<string>::reverse_iterator itr = made.rbegin(); itr != made.rend(); ++itr) { remove(itr->c_str()); }
+	rmdir(root);
+	return (extra || failed) ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * DataPoint for C++ (shared query daemon)
+ *
+ * Serves forecasts and observations to every process on the host over a Unix domain socket, so only this one
+ * holds the API key, the sitelists and the cache, and only this one calls Datapoint. Processes use
+ * datapoint::localclient (see datapoint/local.h) in place of datapoint::api, or weather --socket.
+ *
+ * Build from the repository root, e.g.
+ *   g++ -std=c++17 -O2 -I. daemon/datapointd.cpp datapoint/[a-z]*.cpp -lcurl -pthread -o datapointd
+ *   ./datapointd --setkey 01234567-89ab-cdef-0123-456789abcdef --cache /var/cache/datapoint
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include <signal.h>
+#include <iostream>
+#include <string>
+
+#include "datapoint/local.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+	string key = "", path = LOCAL_SOCKET, url = "", cache = "";
+	bool needhelp = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg != "--help" && i + 1 >= argc) {
+			cout << "Missing a value after \"" << arg << "\"\n";
+			needhelp = true;
+			break;
+		}
+		if (arg == "--setkey") {
+			key = argv[++i];
+		} else if (arg == "--socket") {
+			path = argv[++i];
+		} else if (arg == "--url") {
+			url = argv[++i];
+		} else if (arg == "--cache") {
+			cache = argv[++i];
+		} else {
+			needhelp = true;
+			break;
+		}
+	}
+	if (needhelp || key == "") {
+		cout << "\nUsage: " << string(argv[0]) << " --setkey key [--socket " << LOCAL_SOCKET << "] [--url base] [--cache directory]\n"
+				"\t--setkey\tRequired: Datapoint API Key\n"
+				"\t--socket\tOptional: Where to listen for clients\n"
+				"\t--url\t\tOptional: Datapoint base URL, up to and including /val\n"
+				"\t--cache\t\tOptional: Directory to keep responses in between restarts\n\n";
+		return 1;
+	}
+
+	/*
+	 * SIGINT and SIGTERM are blocked before any thread starts, so they all inherit that and the main thread can
+	 * simply wait for one.
+	 */
+	sigset_t stop;
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, NULL);
+
+	datapoint::localserver server(key);
+	if (url != "") { server.Source().Seturl(url); }
+	if (cache != "") { server.Source().Setcache(cache); }
+	if (!server.Listen(path)) {
+		cout << "Couldn't get the sitelists, or listen on " << path << endl;
+		return 1;
+	}
+	cout << "Serving DataPoint on " << path << endl;
+
+	int received;
+	sigwait(&stop, &received);
+	server.Stop();
+	return 0;
+}
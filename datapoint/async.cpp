@@ -0,0 +1,277 @@
+/*
+ * DataPoint for C++
+ *
+ * Asynchronous requests, see async.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/async.h"
+
+#include <algorithm>
+
+using namespace std;
+
+#define ENGINE_POLL_MS 1000 //Longest the loop sleeps before rechecking for new work, curl_multi_wakeup cuts it short
+
+static size_t write_request(void *ptr, size_t size, size_t nmemb, string *body) {
+	size_t numBytes = size * nmemb;
+	body->append((char*)ptr, numBytes);
+	return numBytes;
+}
+
+datapoint::engine::engine(shared_ptr<connectionpool> inpool) : pool(inpool), stopping(false), active(0) {
+	multi = curl_multi_init();
+	loop = thread(&engine::Run, this);
+}
+
+datapoint::engine::~engine() {
+	{
+		lock_guard<mutex> guard(pending_lock); //Fetch and Post check it under the same lock, see Run
+		stopping = true;
+	}
+	curl_multi_wakeup(multi);
+	loop.join();
+	curl_multi_cleanup(multi);
+}
+
+void datapoint::engine::Fetch(string url, callback done, string etag, string modified, scheduling by) {
+	request *req = new request;
+	req->url = url;
+	req->done = done;
+	req->etag = etag;
+	req->modified = modified;
+	req->by = by;
+	{
+		lock_guard<mutex> guard(pending_lock);
+		if (!stopping) {
+			active++;
+			pending.push_back(req);
+			req = nullptr;
+		}
+	}
+	if (req) { //Too late for the loop to see it
+		req->timing.code = CURLE_ABORTED_BY_CALLBACK;
+		Invoke([req]() { req->done(CURLE_ABORTED_BY_CALLBACK, 0, req->body, req->received, req->timing); });
+		delete req;
+		return;
+	}
+	curl_multi_wakeup(multi);
+}
+
+void datapoint::engine::Post(function<void()> task) {
+	{
+		lock_guard<mutex> guard(pending_lock);
+		if (!stopping) {
+			active++;
+			posted.push_back(std::move(task));
+			task = nullptr;
+		}
+	}
+	if (task) {
+		Invoke(task);
+		return;
+	}
+	curl_multi_wakeup(multi);
+}
+
+void datapoint::engine::Invoke(const function<void()> &task) {
+	try {
+		task();
+	} catch (...) {
+		//The callback was the only place to report it, so there's nowhere left to send it
+	}
+}
+
+/*
+ * New requests from pending. Unscheduled ones start at once. Scheduled ones join an identical request already
+ * here, or are held until the scheduler has a token for them.
+ */
+void datapoint::engine::Queue(request *req) {
+	if (!req->by.queue) {
+		Start(req);
+		return;
+	}
+	string key = req->url + "\n" + req->etag + "\n" + req->modified;
+	unordered_map<string, request *>::iterator itr = flights.find(key);
+	if (itr != flights.end()) {
+		itr->second->followers.push_back(req);
+		return;
+	}
+	req->key = key;
+	flights.emplace(key, req);
+	req->due = chrono::steady_clock::now();
+	held.push_back(req);
+}
+
+/*
+ * Starts whatever held requests are due and can get a token, most important first. One that can't is put off
+ * for as long as the scheduler says.
+ */
+void datapoint::engine::Admit() {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	for (int p = 0; p < scheduler::PRIORITIES; p++) {
+		for (size_t i = 0; i < held.size(); ) {
+			request *req = held[i];
+			chrono::steady_clock::duration wait;
+			if (req->by.priority != p || req->due > now) {
+				i++;
+			} else if (!req->by.queue->TryAcquire(req->by.priority, wait)) {
+				req->due = now + wait;
+				i++;
+			} else {
+				held.erase(held.begin() + i);
+				Start(req);
+			}
+		}
+	}
+}
+
+int datapoint::engine::Wait() const { //Milliseconds the loop may sleep before a held request is due
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	long long wait = ENGINE_POLL_MS;
+	for (const request *req : held) {
+		wait = min(wait, max(0LL, (long long)chrono::ceil<chrono::milliseconds>(req->due - now).count()));
+	}
+	return (int)wait;
+}
+
+void datapoint::engine::Start(request *req) {
+	req->connection = pool->Acquire();
+	if (req->etag != "") {
+		req->headers = curl_slist_append(req->headers, ("If-None-Match: " + req->etag).c_str());
+	}
+	if (req->modified != "") {
+		req->headers = curl_slist_append(req->headers, ("If-Modified-Since: " + req->modified).c_str());
+	}
+	curl_easy_setopt(req->connection, CURLOPT_URL, req->url.c_str());
+	curl_easy_setopt(req->connection, CURLOPT_WRITEFUNCTION, write_request);
+	curl_easy_setopt(req->connection, CURLOPT_WRITEDATA, &req->body);
+	curl_easy_setopt(req->connection, CURLOPT_HEADERFUNCTION, cache::Header);
+	curl_easy_setopt(req->connection, CURLOPT_HEADERDATA, &req->received);
+	curl_easy_setopt(req->connection, CURLOPT_HTTPHEADER, req->headers);
+	curl_easy_setopt(req->connection, CURLOPT_PRIVATE, req);
+	curl_multi_add_handle(multi, req->connection);
+	inflight.push_back(req);
+}
+
+void datapoint::engine::Finish(request *req, CURLcode code) {
+	req->timing.Read(req->connection);
+	req->timing.code = code;
+	long status = req->timing.status;
+	inflight.erase(find(inflight.begin(), inflight.end(), req));
+	curl_multi_remove_handle(multi, req->connection);
+	curl_easy_setopt(req->connection, CURLOPT_HTTPHEADER, NULL);
+	curl_easy_setopt(req->connection, CURLOPT_HEADERFUNCTION, NULL); //req is deleted below, nothing may point into it
+	curl_easy_setopt(req->connection, CURLOPT_HEADERDATA, NULL);
+	curl_easy_setopt(req->connection, CURLOPT_WRITEDATA, NULL);
+	curl_easy_setopt(req->connection, CURLOPT_PRIVATE, NULL);
+	pool->Release(req->connection);
+	req->connection = nullptr;
+	curl_slist_free_all(req->headers);
+	req->headers = nullptr;
+
+	scheduler::response got;
+	got.code = code;
+	got.status = status;
+	chrono::milliseconds backoff;
+	if (req->by.queue && !stopping && req->by.queue->Retry(got, req->attempt, backoff)) {
+		req->attempt++;
+		if (req->by.retrying) { Invoke([req]() { req->by.retrying(req->attempt); }); }
+		req->body.clear();
+		req->received = cacheentry();
+		req->timing = metrics::sample();
+		req->due = chrono::steady_clock::now() + backoff;
+		held.push_back(req); //Still the one in flights, so identical requests keep joining it
+		return;
+	}
+	Complete(req, code, status);
+}
+
+/*
+ * Hands the result to the request and everyone who joined it. Followers get copies, as a callback may take
+ * the body.
+ */
+void datapoint::engine::Complete(request *req, CURLcode code, long status) {
+	if (req->key != "") { flights.erase(req->key); }
+	for (request *follower : req->followers) {
+		string body = req->body;
+		cacheentry received = req->received;
+		metrics::sample timing = req->timing;
+		timing.coalesced = true;
+		active--;
+		Invoke([&]() { follower->done(code, status, body, received, timing); });
+		delete follower;
+	}
+	active--;
+	Invoke([req, code, status]() { req->done(code, status, req->body, req->received, req->timing); });
+	delete req;
+}
+
+void datapoint::engine::Run() {
+	int running = 0;
+	while (!stopping) {
+		deque<request *> starting;
+		deque<function<void()> > tasks;
+		{
+			lock_guard<mutex> guard(pending_lock);
+			starting.swap(pending);
+			tasks.swap(posted);
+		}
+		for (request *req : starting) {
+			Queue(req);
+		}
+		for (const function<void()> &task : tasks) {
+			active--;
+			Invoke(task);
+		}
+		Admit();
+
+		curl_multi_perform(multi, &running);
+		int queued = 0;
+		while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+			if (msg->msg == CURLMSG_DONE) {
+				request *req = nullptr;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&req);
+				Finish(req, msg->data.result);
+			}
+		}
+		curl_multi_poll(multi, NULL, 0, Wait(), NULL);
+	}
+
+	/*
+	 * Shutting down. stopping was set under pending_lock, so once this swap has the lock nothing more can be
+	 * queued: later Fetch and Post calls, callbacks' included, complete on their own thread. Anything unfinished
+	 * is failed rather than dropped, so every callback runs exactly once. Nothing is retried from here on.
+	 */
+	deque<request *> starting;
+	deque<function<void()> > tasks;
+	{
+		lock_guard<mutex> guard(pending_lock);
+		starting.swap(pending);
+		tasks.swap(posted);
+	}
+	for (request *req : starting) {
+		req->timing.code = CURLE_ABORTED_BY_CALLBACK;
+		Complete(req, CURLE_ABORTED_BY_CALLBACK, 0);
+	}
+	for (const function<void()> &task : tasks) {
+		active--;
+		Invoke(task);
+	}
+	for (request *req : held) {
+		req->timing.code = CURLE_ABORTED_BY_CALLBACK;
+		Complete(req, CURLE_ABORTED_BY_CALLBACK, 0);
+	}
+	held.clear();
+	while (!inflight.empty()) {
+		Finish(inflight.back(), CURLE_ABORTED_BY_CALLBACK);
+	}
+}
+
+shared_ptr<datapoint::engine> datapoint::engine::Shared() {
+	static shared_ptr<engine> shared = make_shared<engine>();
+	return shared;
+}
@@ -0,0 +1,96 @@
+/*
+ * DataPoint for C++
+ *
+ * Asynchronous requests. One thread runs a curl_multi loop and can have hundreds of transfers in flight at
+ * once. Callers hand over a URL and a completion callback and carry on. The callback runs on the engine's
+ * thread when the transfer finishes, so it should be quick. Decoding a response is fine, blocking on I/O isn't.
+ * An exception thrown by a callback is caught and dropped there, so it can't take the loop down.
+ *
+ * Given a scheduler, a request waits for a fair use token without blocking the loop, is retried after a
+ * transient failure, and shares the transfer of an identical request already on this engine.
+ *
+ */
+
+#ifndef DATAPOINT_ASYNC_H_
+#define DATAPOINT_ASYNC_H_
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "cache.h"
+#include "connection.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+namespace datapoint {
+		class engine {
+			public:
+				typedef std::function<void(CURLcode code, long status, std::string &body, cacheentry &headers, metrics::sample &timing)> callback;
+				class scheduling {
+					public:
+						std::shared_ptr<scheduler> queue; //nullptr sends the request straight out, as before
+						scheduler::priority priority;
+						std::function<void(unsigned int attempt)> retrying; //Before each retry, on the engine thread
+						scheduling() : priority(scheduler::NORMAL) {} //Fetch's default argument can't use a member initializer
+				} ;
+			private:
+				class request {
+					public:
+						std::string url;
+						std::string etag; //Sent as If-None-Match when set
+						std::string modified; //Sent as If-Modified-Since when set
+						callback done;
+						CURL *connection = nullptr;
+						struct curl_slist *headers = nullptr;
+						std::string body;
+						cacheentry received; //ETag and Last-Modified of the response
+						metrics::sample timing; //Network phases, filled in when the transfer finishes
+						scheduling by;
+						unsigned int attempt = 0;
+						std::chrono::steady_clock::time_point due; //While held, when it may next try for a token
+						std::string key; //Coalescing key, set once it's in flights
+						std::vector<request *> followers; //Identical requests sharing this one's transfer
+				} ;
+				std::shared_ptr<connectionpool> pool;
+				CURLM *multi;
+				std::mutex pending_lock;
+				std::deque<request *> pending; //Handed over by callers, not yet added to multi
+				std::deque<std::function<void()> > posted; //Run by the loop before its next transfers
+				std::vector<request *> inflight; //Added to multi. Only touched by the loop thread.
+				std::vector<request *> held; //Scheduled ones waiting for a token or their retry. Loop thread only.
+				std::unordered_map<std::string, request *> flights; //Coalescing key to the request doing the work. Loop thread only.
+				std::atomic<bool> stopping;
+				std::atomic<size_t> active;
+				std::thread loop;
+				void Run();
+				void Queue(request *req);
+				void Admit();
+				int Wait() const;
+				void Start(request *req);
+				void Finish(request *req, CURLcode code);
+				void Complete(request *req, CURLcode code, long status);
+				void Invoke(const std::function<void()> &task);
+			public:
+				engine(std::shared_ptr<connectionpool> inpool = connectionpool::Shared());
+				~engine(); //Waits for the loop thread. Requests still in flight complete with CURLE_ABORTED_BY_CALLBACK.
+				engine(const engine &) = delete;
+				engine & operator=(const engine &) = delete;
+				void Fetch(std::string url, callback done, std::string etag = "", std::string modified = "", scheduling by = scheduling());
+				void Post(std::function<void()> task); //Runs task on the engine thread, for results that need no transfer
+				//Once the engine is stopping, Fetch fails and Post runs at once, both on the caller's thread.
+				size_t Active() const { return active; } //Requests handed over and not yet completed
+				static std::shared_ptr<engine> Shared();
+		} ;//engine
+} //datapoint
+
+#endif /* DATAPOINT_ASYNC_H_ */
@@ -0,0 +1,116 @@
+/*
+ * DataPoint for C++
+ *
+ * On-disk cache of Datapoint responses, see cache.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/cache.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define CACHE_MAGIC "DPC1"
+
+datapoint::cache::cache(string directory) : dir(directory) {
+	if (!dir.empty() && dir.back() == '/') { dir.pop_back(); }
+	mkdir(dir.c_str(), 0755); //Already there is fine, anything worse shows up as a miss later.
+}
+
+string datapoint::cache::Key(const string &func, bool isForecast) {
+	return string((isForecast) ? "wxfcs/" : "wxobs/") + func;
+}
+
+time_t datapoint::cache::TTL(const string &func, bool isForecast) {
+	if (func.compare(0, 8, "sitelist") == 0) { return CACHE_TTL_SITELIST; }
+	return (isForecast) ? CACHE_TTL_FORECAST : CACHE_TTL_OBSERVATION;
+}
+
+string datapoint::cache::Path(const string &key) const {
+	//FNV-1a, so funcs with '?' and '&' in them make tidy file names.
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : key) {
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+	return dir + "/" + name + ".json";
+}
+
+/*
+ * Entry layout, a short text header followed by the untouched response body:
+ *   DPC1\n <fetched> <expires>\n <etag>\n <last-modified>\n <body>
+ */
+bool datapoint::cache::Get(const string &key, cacheentry &entry) const {
+	ifstream in(Path(key), ios_base::in | ios_base::binary);
+	if (!in) { return false; }
+	string magic, times;
+	if (!getline(in, magic) || magic != CACHE_MAGIC) { return false; }
+	if (!getline(in, times) || !getline(in, entry.etag) || !getline(in, entry.modified)) { return false; }
+	long long fetched = 0, expires = 0;
+	if (sscanf(times.c_str(), "%lld %lld", &fetched, &expires) != 2) { return false; }
+	entry.fetched = fetched;
+	entry.expires = expires;
+	ostringstream body;
+	body << in.rdbuf();
+	entry.body = body.str();
+	return true;
+}
+
+bool datapoint::cache::Put(const string &key, const cacheentry &entry) const {
+	/*
+	 * Write beside the real entry then rename over it, so a reader in another thread or process never sees half a file.
+	 */
+	static atomic<unsigned long> written(0);
+	string path = Path(key);
+	string temp = path + "." + to_string(getpid()) + "." + to_string(written++) + ".tmp";
+	{
+		ofstream out(temp, ios_base::out | ios_base::binary | ios_base::trunc);
+		if (!out) { return false; }
+		out << CACHE_MAGIC << "\n" << (long long)entry.fetched << " " << (long long)entry.expires << "\n"
+				<< entry.etag << "\n" << entry.modified << "\n";
+		out.write(entry.body.data(), entry.body.size());
+		if (!out) {
+			out.close();
+			remove(temp.c_str());
+			return false;
+		}
+	}
+	if (rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * cURL header callback. Picks ETag and Last-Modified out of the response headers into the entry.
+ */
+size_t datapoint::cache::Header(char *ptr, size_t size, size_t nmemb, cacheentry *entry) {
+	size_t numBytes = size * nmemb;
+	string line(ptr, numBytes);
+	while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) { line.pop_back(); }
+	size_t colon = line.find(':');
+	if (colon != string::npos) {
+		string name = line.substr(0, colon);
+		string value = line.substr(colon + 1);
+		value.erase(0, value.find_first_not_of(' '));
+		for (char &c : name) { c = tolower(c); }
+		if (name == "etag") { entry->etag = value; }
+		if (name == "last-modified") { entry->modified = value; }
+	}
+	return numBytes;
+}
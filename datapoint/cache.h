@@ -0,0 +1,45 @@
+/*
+ * DataPoint for C++
+ *
+ * On-disk cache of Datapoint responses. Entries are keyed by endpoint and 'func' (never the API key) and kept
+ * for as long as Datapoint's own update cadence makes them worth keeping: an hour for observations, three
+ * hours for forecasts and a week for sitelists. Once an entry goes stale it's revalidated with
+ * If-None-Match / If-Modified-Since, so an unchanged resource costs a 304 rather than a full download.
+ *
+ */
+
+#ifndef DATAPOINT_CACHE_H_
+#define DATAPOINT_CACHE_H_
+
+#include <ctime>
+#include <string>
+
+#define CACHE_TTL_OBSERVATION 3600 //Seconds. Observations are published hourly.
+#define CACHE_TTL_FORECAST 10800 //3 hourly forecasts are re-run roughly every three hours.
+#define CACHE_TTL_SITELIST 604800 //Sites come and go very rarely, a week is plenty.
+
+namespace datapoint {
+		class cacheentry {
+			public:
+				std::string body;
+				std::string etag; //As sent by Datapoint, quotes included. May be empty.
+				std::string modified; //Last-Modified as sent by Datapoint. May be empty.
+				time_t fetched = 0;
+				time_t expires = 0;
+				bool Fresh(time_t now) const { return now < expires; }
+		} ;//cacheentry
+		class cache {
+			private:
+				std::string dir;
+				std::string Path(const std::string &key) const;
+			public:
+				cache(std::string directory); //Created if missing
+				bool Get(const std::string &key, cacheentry &entry) const;
+				bool Put(const std::string &key, const cacheentry &entry) const;
+				static std::string Key(const std::string &func, bool isForecast);
+				static time_t TTL(const std::string &func, bool isForecast);
+				static size_t Header(char *ptr, size_t size, size_t nmemb, cacheentry *entry); //cURL CURLOPT_HEADERFUNCTION
+		} ;//cache
+} //datapoint
+
+#endif /* DATAPOINT_CACHE_H_ */
@@ -0,0 +1,93 @@
+/*
+ * DataPoint for C++
+ *
+ * Reusable cURL connections, see connection.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/connection.h"
+
+using namespace std;
+
+static once_flag curl_ready;
+
+datapoint::connectionpool::connectionpool() {
+	call_once(curl_ready, []() { curl_global_init(CURL_GLOBAL_DEFAULT); }); //Not thread safe in cURL itself, so do it once here.
+	share = curl_share_init();
+	curl_share_setopt(share, CURLSHOPT_LOCKFUNC, Lock);
+	curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, Unlock);
+	curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+datapoint::connectionpool::~connectionpool() {
+	for (CURL *connection : idle) {
+		curl_easy_cleanup(connection);
+	}
+	curl_share_cleanup(share);
+}
+
+void datapoint::connectionpool::Lock(CURL *, curl_lock_data data, curl_lock_access, void *pool) {
+	static_cast<connectionpool *>(pool)->locks[data].lock();
+}
+
+void datapoint::connectionpool::Unlock(CURL *, curl_lock_data data, void *pool) {
+	static_cast<connectionpool *>(pool)->locks[data].unlock();
+}
+
+CURL * datapoint::connectionpool::Acquire() {
+	{
+		lock_guard<mutex> guard(idle_lock);
+		if (!idle.empty()) {
+			CURL *connection = idle.back();
+			idle.pop_back();
+			return connection;
+		}
+	}
+
+	CURL *connection = curl_easy_init();
+	Configure(connection);
+	return connection;
+}
+
+/*
+ * Options that never change between requests are set here, on new handles and again after each reset. Callers
+ * only set the URL, where to write and any request headers.
+ */
+void datapoint::connectionpool::Configure(CURL *connection) {
+	curl_easy_setopt(connection, CURLOPT_SHARE, share);
+	curl_easy_setopt(connection, CURLOPT_TIMEOUT, 10L); // Don't wait forever, time out after 10 seconds
+	curl_easy_setopt(connection, CURLOPT_FOLLOWLOCATION, 1L); // Follow HTTP redirects if necessary
+	curl_easy_setopt(connection, CURLOPT_ACCEPT_ENCODING, ""); // Any compression cURL was built with, gzip/deflate at least
+	curl_easy_setopt(connection, CURLOPT_TCP_KEEPALIVE, 1L); // Keepalive probes, so a connection that died while idle is noticed
+	curl_easy_setopt(connection, CURLOPT_NOSIGNAL, 1L); // Handles move between threads
+}
+
+void datapoint::connectionpool::Release(CURL *connection) {
+	if (!connection) { return; }
+
+	/*
+	 * Whoever had it last left their callbacks and userdata set, pointing at things that are gone by now. A reset
+	 * clears every option but keeps the handle's open connections and caches, then the shared options go back on.
+	 */
+	curl_easy_reset(connection);
+	Configure(connection);
+	{
+		lock_guard<mutex> guard(idle_lock);
+		if (idle.size() < CONNECTION_IDLE_MAX) {
+			idle.push_back(connection);
+			return;
+		}
+	}
+	curl_easy_cleanup(connection);
+}
+
+shared_ptr<datapoint::connectionpool> datapoint::connectionpool::Shared() {
+	static shared_ptr<connectionpool> pool = make_shared<connectionpool>();
+	return pool;
+}
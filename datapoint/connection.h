@@ -0,0 +1,42 @@
+/*
+ * DataPoint for C++
+ *
+ * Reusable cURL connections. Easy handles are kept after each request rather than cleaned up, and all of them
+ * share one CURLSH for DNS, open connections and TLS sessions. Back to back calls to Datapoint then skip the
+ * lookup and connection setup. Responses are requested compressed.
+ *
+ */
+
+#ifndef DATAPOINT_CONNECTION_H_
+#define DATAPOINT_CONNECTION_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <curl/curl.h>
+
+#define CONNECTION_IDLE_MAX 8 //Handles kept beyond this are cleaned up on release
+
+namespace datapoint {
+		class connectionpool {
+			private:
+				CURLSH *share;
+				std::mutex locks[CURL_LOCK_DATA_LAST]; //One per type of shared data, as cURL asks for
+				std::mutex idle_lock;
+				std::vector<CURL *> idle;
+				static void Lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *pool);
+				static void Unlock(CURL *handle, curl_lock_data data, void *pool);
+				void Configure(CURL *connection); //The options every request shares
+			public:
+				connectionpool();
+				~connectionpool();
+				connectionpool(const connectionpool &) = delete;
+				connectionpool & operator=(const connectionpool &) = delete;
+				CURL * Acquire(); //A configured handle, new or reused. Give it back with Release.
+				void Release(CURL *connection); //Resets it, so no callback or pointer from the last request survives
+				static std::shared_ptr<connectionpool> Shared(); //Process wide pool used by api objects by default
+		} ;//connectionpool
+} //datapoint
+
+#endif /* DATAPOINT_CONNECTION_H_ */
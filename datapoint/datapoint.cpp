@@ -23,8 +23,13 @@
 #define OBSERVATION false
 
 #include "../datapoint/datapoint.h"
+#include "../datapoint/fields.h"
+#include "../datapoint/stream.h"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 
 #include <curl/curl.h>
 #include <rapidjson/reader.h>
@@ -38,7 +43,7 @@ size_t write_curlbuffer(void *ptr, size_t size, size_t nmemb, curlbuffer *data)
     if (data->file)
         data->file->write((char*)ptr, numBytes);
     if (data->str)
-        *(data->str) += std::string((char*)ptr, numBytes);
+        data->str->append((char*)ptr, numBytes); //In place, no temporary string per chunk
     return numBytes;
 }
 
@@ -46,55 +51,362 @@ rapidjson::Document datapoint::api::Call(std::string func, bool isForecast) {
 
     if(key == "" || func == "") {
     	//TODO: Invalid key or func request, deal with it safely. Maybe return an error in JSON format or something.
-    	cout << "Couldn't create valid payload for Datapoint. Crashed instead of wasting a request." << endl ;
+    	Errors() << "Couldn't create valid payload for Datapoint. Crashed instead of wasting a request." << endl ;
     	throw 1;
     }
 
+    /*
+     * With a cache set, a fresh entry is returned without touching the network. A stale one is sent back to
+     * Datapoint as If-None-Match/If-Modified-Since, and a 304 just extends its life.
+     */
+    metrics::sample sample(metrics::Endpoint(func, isForecast));
+    time_t now = time(nullptr);
+    std::string cachekey = cache::Key(func, isForecast);
+    cacheentry cached;
+    bool haveCached = responses && responses->Get(cachekey, cached);
+    if (haveCached && cached.Fresh(now)) {
+    	sample.result = metrics::CACHED;
+    	rapidjson::Document json = Parse(cached.body, sample);
+    	Record(sample);
+    	return json;
+    }
+
+    /*
+     * The request itself goes through the scheduler (unless Setscheduler(nullptr)), which shares it with anyone
+     * already asking for the same thing, waits for a fair use token and retries transient failures.
+     */
+    std::string payload = Url(func, isForecast);
+    std::string etag = (haveCached) ? cached.etag : "" ;
+    std::string modified = (haveCached) ? cached.modified : "" ;
+    std::shared_ptr<const scheduler::response> got;
+    bool coalesced = false;
+    if (queue) {
+    	std::shared_ptr<metrics> recorder = stats;
+    	metrics::endpoint where = sample.where;
+    	got = queue->Fetch(payload + "\n" + etag + "\n" + modified, scheduler::Priority(func, isForecast), [&](unsigned int attempt) {
+    		if (attempt && recorder) { recorder->Retry(where); }
+    		return Perform(payload, etag, modified, sample);
+    	}, &coalesced);
+    } else {
+    	got = std::make_shared<const scheduler::response>(Perform(payload, etag, modified, sample));
+    }
+    long status = got->status;
+    sample.coalesced = coalesced; //Counted as such, but recorded under how the shared request went
+
+    if (got->code == CURLE_OK) {
+    	if (status == 304 && haveCached) {
+    		cached.fetched = now;
+    		cached.expires = now + cache::TTL(func, isForecast);
+    		responses->Put(cachekey, cached);
+    		sample.result = metrics::REVALIDATED;
+    		rapidjson::Document json = Parse(cached.body, sample);
+    		Record(sample);
+    		return json;
+    	}
+
+    	sample.result = metrics::FETCHED;
+    	rapidjson::Document json = Parse(got->body, sample);
+    	if (responses && status == 200) { //Only worth keeping once we know it parses
+    		cacheentry fetched = got->headers;
+    		fetched.body = got->body;
+    		fetched.fetched = now;
+    		fetched.expires = now + cache::TTL(func, isForecast);
+    		responses->Put(cachekey, fetched);
+    	}
+    	Record(sample);
+    	return json;
+
+    } else {
+    	sample.result = metrics::FAILED;
+    	Record(sample);
+    	//TODO: HTTP Failed, deal with it safely. Maybe return an error in JSON format, throw, or something.
+    	Errors() << "Error: " << got->code << endl ;
+    	Errors() << "DataPoint has not returned any data, this could be due to an incorrect API key" << endl ;
+    	throw 1;
+    }
+    curl_global_cleanup();
+
+};
+
+/*
+ * One GET on a pooled connection, with conditional headers when there's a stale cache entry to revalidate.
+ */
+datapoint::scheduler::response datapoint::api::Perform(const std::string &payload, const std::string &etag,
+		const std::string &modified, metrics::sample &sample) {
     CURL *connection;
     curlbuffer curlbuffer;
-    fstream curlfile("content.json", ios_base::out | ios_base::ate);
-    string curlstream;
-    curlbuffer.file = &curlfile;
-    curlbuffer.str = &curlstream;
-
-    connection = curl_easy_init();
-    std::string url;
-    (isForecast) ? url = url_forecast : url = url_obs ; //Allow both forecast and observation calls
+    scheduler::response got;
+    curlbuffer.file = NULL; //The cache keeps what's worth keeping, no need for a scratch file.
+    curlbuffer.str = &got.body;
+    struct curl_slist *headers = NULL;
+    if (etag != "") {
+    	headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+    }
+    if (modified != "") {
+    	headers = curl_slist_append(headers, ("If-Modified-Since: " + modified).c_str());
+    }
+
+    connection = pool->Acquire(); //Timeout, redirects, compression and keep-alive are already set on pooled handles
+
+    curl_easy_setopt(connection, CURLOPT_URL, payload.c_str());
+	curl_easy_setopt(connection, CURLOPT_WRITEFUNCTION, write_curlbuffer);
+	curl_easy_setopt(connection, CURLOPT_WRITEDATA, &curlbuffer);
+	curl_easy_setopt(connection, CURLOPT_HEADERFUNCTION, cache::Header);
+	curl_easy_setopt(connection, CURLOPT_HEADERDATA, &got.headers);
+	curl_easy_setopt(connection, CURLOPT_HTTPHEADER, headers); //NULL clears whatever the last user of this handle sent
+
+	// Run our HTTP GET command, capture the HTTP response code, and hand the connection back for the next call.
+	got.code = curl_easy_perform(connection);
+	sample.Read(connection); //Phase times, size and status
+	sample.code = got.code;
+	got.status = sample.status;
+	curl_easy_setopt(connection, CURLOPT_HTTPHEADER, NULL);
+	pool->Release(connection);
+	curl_slist_free_all(headers);
+	return got;
+}
+
+std::string datapoint::api::Url(std::string func, bool isForecast) {
+    std::string url = url_base;
+    (isForecast) ? url += url_forecast : url += url_obs ; //Allow both forecast and observation calls
     ( std::strstr(func.c_str(),"?") ) ? func += "&" : func += "?" ; //Append GET as needed
 
     std::string payload = url + "/" + func + "key=" + key ;
 
     //cout << "Datapoint Payload: " << payload << endl; //XXX: Uncomment to see what the URL used is when debugging.
+    return payload;
+}
 
-    curl_easy_setopt(connection, CURLOPT_URL, payload.c_str());
-	curl_easy_setopt(connection, CURLOPT_TIMEOUT, 10); // Don't wait forever, time out after 10 seconds
-	curl_easy_setopt(connection, CURLOPT_FOLLOWLOCATION, 1L); // Follow HTTP redirects if necessary
-	curl_easy_setopt(connection, CURLOPT_WRITEFUNCTION, write_curlbuffer);
-	curl_easy_setopt(connection, CURLOPT_WRITEDATA, &curlbuffer);
+/*
+ * Streaming alternative to Call. The response is parsed as it downloads, straight into the handler's records,
+ * so there's never a full copy of the body or a DOM in memory. Used when Setstreaming(true) and no cache is set,
+ * and by the bulk exports whenever there's no cache.
+ */
+void datapoint::api::Stream(std::string func, bool isForecast, recordhandler &handler) {
+    if(key == "" || func == "") {
+    	Errors() << "Couldn't create valid payload for Datapoint. Crashed instead of wasting a request." << endl ;
+    	throw 1;
+    }
 
-	// Run our HTTP GET command, capture the HTTP response code, and clean up.
-	CURLcode errorCode =  curl_easy_perform(connection);
-	curl_easy_cleanup(connection);
-    if (errorCode == CURLE_OK) {
-    	rapidjson::Document json;
+    /*
+     * Parsing happens as the body arrives, so its time is part of 'transfer' rather than a phase of its own. The
+     * scheduler rate limits and retries it, but can't share it, as the records go straight to this handler. Once
+     * the handler has records a failure isn't retried either, as they can't be taken back.
+     */
+    std::string payload = Url(func, isForecast);
+    metrics::sample sample(metrics::Endpoint(func, isForecast));
+    bool parsed = false;
+    auto attempt = [&](unsigned int n) {
+    	if (n && stats) { stats->Retry(sample.where); }
+    	handler.Restart();
+    	CURL *connection = pool->Acquire();
+    	curl_easy_setopt(connection, CURLOPT_URL, payload.c_str());
+    	curl_easy_setopt(connection, CURLOPT_HEADERFUNCTION, NULL);
+    	curl_easy_setopt(connection, CURLOPT_HEADERDATA, NULL); //Else headers go to curlstream::Write with the last caller's pointer
+    	curl_easy_setopt(connection, CURLOPT_HTTPHEADER, NULL);
+    	scheduler::response got;
+    	{
+    		curlstream stream(connection);
+    		rapidjson::Reader reader;
+    		parsed = !reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, handler).IsError();
+    		got.code = stream.Result();
+    	}
+    	sample.Read(connection);
+    	sample.code = got.code;
+    	got.status = sample.status;
+    	got.repeatable = handler.Records() == 0;
+    	pool->Release(connection);
+    	return got;
+    };
+    CURLcode errorCode = ((queue) ? queue->Fetch(scheduler::Priority(func, isForecast), std::ref(attempt)) : attempt(0)).code;
 
-        if (json.Parse(curlstream.c_str()).HasParseError()) {
-        	//TODO: JSON Failed, deal with it safely. Maybe return an error in JSON format, throw, or something.
-        	cout << "DataPoint received invalid JSON code and could not parse it." << endl ;
-        	throw 1;
-        } else {
-        	return json;
-        }
+	sample.result = (errorCode == CURLE_OK && parsed) ? metrics::FETCHED : metrics::FAILED;
+	Record(sample);
 
-    } else {
-    	//TODO: HTTP Failed, deal with it safely. Maybe return an error in JSON format, throw, or something.
-    	cout << "Error: " << errorCode << endl ;
-    	cout << "DataPoint has not returned any data, this could be due to an incorrect API key" << endl ;
+	if (errorCode != CURLE_OK) {
+		Errors() << "Error: " << errorCode << endl ;
+		Errors() << "DataPoint has not returned any data, this could be due to an incorrect API key" << endl ;
+		throw 1;
+	} else if (!parsed) {
+		Errors() << "DataPoint received invalid JSON code and could not parse it." << endl ;
+		throw 1;
+	}
+}
+
+/*
+ * Call for the workspace. One site by ID, with the URL built, the body downloaded and the JSON parsed all in
+ * buffers the workspace keeps, so a warmed up workspace gets through this without allocating. Like Stream it's
+ * rate limited and retried by the scheduler but not coalesced, as the body is this workspace's. The result lives
+ * in the workspace, and is only good until its next call.
+ */
+const rapidjson::Value & datapoint::api::Call(unsigned int id, const char *query, bool isForecast, workspace &into) {
+    if(key == "" || id == 0) {
+    	Errors() << "Couldn't create valid payload for Datapoint. Crashed instead of wasting a request." << endl ;
     	throw 1;
     }
-    curl_global_cleanup();
 
-};
+    metrics::sample sample((isForecast) ? metrics::FORECASTS : metrics::OBSERVATIONS);
+    into.Url(url_base, (isForecast) ? url_forecast : url_obs, id, query, key);
+    auto attempt = [&](unsigned int n) {
+    	if (n && stats) { stats->Retry(sample.where); }
+    	into.body.clear(); //Keeps its capacity
+    	curlbuffer curlbuffer;
+    	curlbuffer.file = NULL;
+    	curlbuffer.str = &into.body;
+
+    	CURL *connection = pool->Acquire();
+    	curl_easy_setopt(connection, CURLOPT_URL, into.url.c_str());
+    	curl_easy_setopt(connection, CURLOPT_WRITEFUNCTION, write_curlbuffer);
+    	curl_easy_setopt(connection, CURLOPT_WRITEDATA, &curlbuffer);
+    	curl_easy_setopt(connection, CURLOPT_HEADERFUNCTION, NULL);
+    	curl_easy_setopt(connection, CURLOPT_HEADERDATA, NULL); //Else headers go to write_curlbuffer as the last caller's pointer
+    	curl_easy_setopt(connection, CURLOPT_HTTPHEADER, NULL);
+    	scheduler::response got;
+    	got.code = curl_easy_perform(connection);
+    	sample.Read(connection);
+    	sample.code = got.code;
+    	got.status = sample.status;
+    	pool->Release(connection);
+    	return got;
+    };
+    scheduler::priority priority = (isForecast) ? scheduler::NORMAL : scheduler::HIGH;
+    CURLcode errorCode = ((queue) ? queue->Fetch(priority, std::ref(attempt)) : attempt(0)).code; //By reference, so nothing's allocated
+
+	if (errorCode != CURLE_OK) {
+		sample.result = metrics::FAILED;
+		Record(sample);
+		Errors() << "Error: " << errorCode << endl ;
+		Errors() << "DataPoint has not returned any data, this could be due to an incorrect API key" << endl ;
+		throw 1;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const rapidjson::Value *json = into.Parse();
+	sample.micros[metrics::PARSE] = metrics::Since(start);
+	sample.result = (json) ? metrics::FETCHED : metrics::FAILED;
+	Record(sample);
+	if (!json) {
+		Errors() << "DataPoint received invalid JSON code and could not parse it." << endl ;
+		throw 1;
+	}
+	return *json;
+}
+
+/*
+ * Metrics go to a per api object collector by default. Share one between api objects to see the whole process,
+ * and read it back with Getmetrics.
+ */
+void datapoint::api::Setmetrics(std::shared_ptr<metrics> inmetrics) {
+	stats = inmetrics;
+}
+std::shared_ptr<datapoint::metrics> datapoint::api::Getmetrics() { return stats; }
+
+/*
+ * Every api object shares scheduler::Shared(), and so the one fair use budget, unless given its own here.
+ * nullptr sends requests straight out with no coalescing, rate limit or retries.
+ */
+void datapoint::api::Setscheduler(std::shared_ptr<scheduler> inscheduler) {
+	queue = inscheduler;
+}
+
+/*
+ * Failures are printed before the exception is thrown, on cout unless sent elsewhere here. Use &cerr to keep
+ * them out of output written to stdout, or nullptr when something else is counting failures.
+ */
+void datapoint::api::Seterrors(std::ostream *inerrors) {
+	errors = inerrors;
+}
+std::ostream & datapoint::api::Errors() {
+	static thread_local std::ostream quiet(nullptr); //No buffer, so everything sent to it is dropped
+	return (errors) ? *errors : quiet;
+}
+
+void datapoint::api::Record(const metrics::sample &sample) {
+	if (stats) { stats->Record(sample); }
+}
+
+void datapoint::api::Time(metrics::endpoint where, metrics::phase what, std::chrono::steady_clock::time_point start) {
+	if (stats) { stats->Time(where, what, metrics::Since(start)); }
+}
+
+void datapoint::api::Setstreaming(bool instreaming) {
+	streaming = instreaming;
+}
+
+/*
+ * For loops refreshing the same site. GetForecast(buffer, size), GetObservation() and the typed and history
+ * versions then reuse one set of buffers and a JSON arena, and stop allocating once they're warmed up.
+ */
+void datapoint::api::Setworkspace(bool inreuse) {
+	if (!inreuse) {
+		scratch.reset();
+	} else if (!scratch) {
+		scratch = std::make_shared<workspace>();
+	}
+}
+
+/*
+ * One site's data, by whichever route is set up. Shared by the single and batch Get functions.
+ */
+std::vector<datapoint::forecast> datapoint::api::FetchForecast(unsigned int id) {
+	std::string func = to_string(id) + "?res=3hourly" ; //You can also use "?res=daily" for a Day and Night forecast.
+	if (streaming && !responses) {
+		std::vector<forecast> frcst;
+		forecasthandler handler(&frcst);
+		api::Stream(func, FORECAST, handler) ;
+		return frcst;
+	}
+	rapidjson::Document json = api::Call(func , FORECAST) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<forecast> frcst = DecodeForecast(json);
+	Time(metrics::FORECASTS, metrics::DECODE, start);
+	return frcst;
+}
+
+datapoint::observation datapoint::api::FetchObservation(unsigned int id) {
+	std::string func = to_string(id) + "?res=hourly" ;
+	if (streaming && !responses) {
+		observation obs;
+		observationhandler handler(&obs);
+		api::Stream(func, OBSERVATION, handler) ;
+		if (!handler.found) {
+			Errors() << "DataPoint returned no observations for this site." << endl ;
+			throw 1;
+		}
+		return obs;
+	}
+	rapidjson::Document json = api::Call(func , OBSERVATION) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	observation obs = DecodeObservation(json);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	return obs;
+}
+
+rapidjson::Document datapoint::api::Parse(const std::string &body, metrics::sample &sample) {
+	rapidjson::Document json;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool failed = json.Parse(body.c_str()).HasParseError();
+	sample.micros[metrics::PARSE] = metrics::Since(start);
+	if (failed) {
+		sample.result = metrics::FAILED;
+		Record(sample);
+		//TODO: JSON Failed, deal with it safely. Maybe return an error in JSON format, throw, or something.
+		Errors() << "DataPoint received invalid JSON code and could not parse it." << endl ;
+		throw 1;
+	}
+	return json;
+}
+
+/*
+ * Responses are cached under 'directory', created if need be. Several api objects, threads or processes can
+ * share the same directory.
+ */
+void datapoint::api::Setcache(std::string directory) {
+	responses = std::make_shared<cache>(directory);
+}
+void datapoint::api::Setcache(std::shared_ptr<cache> incache) {
+	responses = incache;
+}
 
 /*
  * Set private stuff if someone adds error handling...
@@ -105,47 +417,24 @@ string datapoint::api::Setkey(string inkey) {
 }
 string datapoint::api::Setkey() { return key; }
 
+/*
+ * Handy for pointing at a local stand-in server when testing, e.g. "http://127.0.0.1:8080/public/data/val"
+ */
+string datapoint::api::Seturl(string inurl) {
+	url_base = inurl;
+	return url_base;
+}
+string datapoint::api::Seturl() { return url_base; }
+
+void datapoint::api::Setpool(std::shared_ptr<connectionpool> inpool) {
+	pool = inpool;
+}
+
 /*
  * To get the location, supply lat and lon. The code then finds the nearest observation point and sets it privately.
  */
 #include <bits/stdc++.h> //MATH!
 
-long double datapoint::api::Distance(long double lat1, long double long1, long double lat2, long double long2) {
-	//TODO: Not using pointers, as we convert double's into long doubles. Can probs tidy this up without losing much?
-	long double toRadians = (M_PI) / 180 ;
-    // Haversine Formula
-    long double dlong = (toRadians*long2) - (toRadians*long1);
-    long double dlat = (toRadians*lat2) - (toRadians*lat1);
-
-    long double ans = pow(sin(dlat / 2), 2) +
-                          cos(lat1) * cos(lat2) *
-                          pow(sin(dlong / 2), 2);
-    ans = 2 * asin(sqrt(ans));
-    long double R = 6371; // Radius of Earth in Kilometres
-    ans = ans * R;
-
-    return ans;
-}
-
-rapidjson::Value::ConstValueIterator datapoint::api::FindNearest(rapidjson::Document *json, double *our_lat, double *our_lon) {
-	long double dist = 0;
-	rapidjson::Document& loc = *json;
-	const rapidjson::Value& locations = loc["Locations"]["Location"];
-	assert(locations.IsArray());
-	rapidjson::Value::ConstValueIterator nearest = locations.Begin();
-	for (rapidjson::Value::ConstValueIterator  itr = nearest; itr != locations.End(); ++itr) {
-	    float json_lat = std::stof( (*itr)["latitude"].GetString() );
-	    float json_lon = std::stof( (*itr)["longitude"].GetString() );
-	    long double newDistance = Distance(*our_lat, *our_lon, json_lat, json_lon) ;
-	    if ( (itr == locations.Begin()) || newDistance < dist ) { //Dist needs setting on first run
-	    	dist = newDistance ;
-	    	nearest = itr;
-	    }
-	}
-
-	return nearest;
-};
-
 bool datapoint::api::Setlocation(double our_lat, double our_lon) {
 	/*
 	 * Co-ords are converted to site ID, Name and Area when the first GetObservation or GetForecast is called as Datapoint has
@@ -164,30 +453,128 @@ bool datapoint::api::Setlocation(double our_lat, double our_lon) {
 
 };
 
+/*
+ * The sitelists are large and rarely change, so they're turned into a siteindex once and kept. Loading a saved
+ * index, or handing over one built by another api object, avoids the sitelist call entirely.
+ */
+std::shared_ptr<const datapoint::siteindex> datapoint::api::Getsites(bool isForecast) {
+	std::shared_ptr<const siteindex> &sites = (isForecast) ? forecast_sites : observation_sites ;
+	if (!sites) {
+		std::shared_ptr<siteindex> built = std::make_shared<siteindex>();
+		bool usable;
+		std::chrono::steady_clock::time_point start;
+		if (streaming && !responses) {
+			sitelisthandler handler;
+			api::Stream("sitelist" , isForecast, handler) ;
+			start = std::chrono::steady_clock::now();
+			usable = built->Build(std::move(handler.sites));
+		} else {
+			rapidjson::Document json = api::Call("sitelist" , isForecast) ;
+			start = std::chrono::steady_clock::now();
+			usable = built->Build(json);
+		}
+		Time(metrics::SITELISTS, metrics::DECODE, start); //Building the index
+		if (!usable) {
+			Errors() << "DataPoint returned a sitelist without any usable locations." << endl ;
+			throw 1;
+		}
+		sites = built;
+	}
+	return sites;
+}
+
+/*
+ * Sets the forecast or observation site ID, Name and Area to the nearest site to our co-ords.
+ */
+void datapoint::api::Locate(bool isForecast) {
+	std::shared_ptr<const siteindex> sites = Getsites(isForecast);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const site *nearest = sites->Nearest(lat, lon);
+	Time(metrics::SITELISTS, metrics::LOCATE, start);
+	if (!nearest) {
+		Errors() << "No DataPoint site near " << lat << ", " << lon << "." << endl ;
+		throw 1;
+	}
+	if (isForecast) {
+		forecast_id = nearest->id;
+		forecast_name = nearest->name;
+		forecast_area = nearest->area;
+	} else {
+		observation_id = nearest->id;
+		observation_name = nearest->name;
+		observation_area = nearest->area;
+	}
+}
+
+void datapoint::api::Setsites(std::shared_ptr<const siteindex> sites, bool isForecast) {
+	if (sites && sites->Empty()) { //nullptr is fine, the next call gets the sitelist again
+		Errors() << "Can't use a sitelist index without any sites." << endl ;
+		throw 1;
+	}
+	(isForecast) ? forecast_sites = sites : observation_sites = sites ;
+	(isForecast) ? forecast_id = 0 : observation_id = 0 ; //Re-resolve against the new list
+}
+
+bool datapoint::api::Loadsites(std::string path, bool isForecast) {
+	std::shared_ptr<siteindex> loaded = std::make_shared<siteindex>();
+	if (!loaded->Load(path)) {
+		return false;
+	}
+	Setsites(loaded, isForecast);
+	return true;
+}
+
+bool datapoint::api::Savesites(std::string path, bool isForecast) {
+	return Getsites(isForecast)->Save(path);
+}
+
+bool datapoint::api::Savesnapshot(std::string path) {
+	/*
+	 * Two "all" calls cover every site, so this costs four requests at most however many sites there are.
+	 */
+	snapshotwriter writer;
+	writer.Sites(*Getsites(FORECAST));
+	writer.Sites(*Getsites(OBSERVATION));
+	rapidjson::Document forecasts = api::Call("all?res=3hourly" , FORECAST) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	writer.Forecasts(forecasts);
+	Time(metrics::FORECASTS, metrics::DECODE, start);
+	rapidjson::Document observations = api::Call("all?res=hourly" , OBSERVATION) ;
+	start = std::chrono::steady_clock::now();
+	writer.Observations(observations);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	return writer.Write(path);
+}
 
 datapoint::observation datapoint::api::GetObservation() {
 	/*
 	 * Assuming we only ever want the last observation;
 	 * Datapoint API will supply the last 24 hours if you want it though.
 	 */
-	rapidjson::Document json;
-	rapidjson::Value::ConstValueIterator itr;
-
 	if (observation_id == 0) {
-		json = api::Call("sitelist" , OBSERVATION) ;
-		itr = datapoint::api::FindNearest(&json, &lat, &lon);
-		observation_id = std::stoul( (*itr)["id"].GetString() ) ;
-		observation_name = (*itr)["name"].GetString() ;
-		( (*itr).HasMember("unitaryAuthArea") ) ? observation_area = (*itr)["unitaryAuthArea"].GetString() : observation_area = "" ;
+		Locate(OBSERVATION);
 	}
 
+	if (scratch && !responses) {
+		const rapidjson::Value &json = api::Call(observation_id, "?res=hourly", OBSERVATION, *scratch) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		observation obs = DecodeObservation(json["SiteRep"]["DV"]["Location"]);
+		Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+		return obs;
+	}
+	return FetchObservation(observation_id);
+};
 
-	std::string func = to_string(observation_id) + "?res=hourly" ;
-	json = api::Call(func , OBSERVATION) ;
-
+datapoint::observation datapoint::api::DecodeObservation(const rapidjson::Document &json) {
 	assert(json.IsObject());
 
-	const rapidjson::Value& days = json["SiteRep"]["DV"]["Location"]["Period"];
+	return DecodeObservation(json["SiteRep"]["DV"]["Location"]);
+}
+
+datapoint::observation datapoint::api::DecodeObservation(const rapidjson::Value &location) {
+	rapidjson::Value::ConstValueIterator itr;
+
+	const rapidjson::Value& days = location["Period"];
 
 	if (days.IsArray()) { //The last hour before midnight, it isn't.
 		assert(days.IsArray());
@@ -211,85 +598,543 @@ datapoint::observation datapoint::api::GetObservation() {
 	 * then decides not to store the decimals and converts again to int. Some users might prefer string anyway.
 	 * As a plus, it means we can return empty strings as a sort of error message to be handled.
 	 */
-	( (*itr).HasMember("T") ) ? obs.temperature = (*itr)["T"].GetString() : obs.temperature = "" ;
-	( (*itr).HasMember("V") ) ? obs.visibility = (*itr)["V"].GetString() : obs.visibility = "" ;
-	( (*itr).HasMember("D") ) ? obs.windDirection = (*itr)["D"].GetString() : obs.windDirection = "" ;
-	( (*itr).HasMember("S") ) ? obs.windSpeed = (*itr)["S"].GetString() : obs.windSpeed = "" ;
-	( (*itr).HasMember("G") ) ? obs.windGust = (*itr)["G"].GetString() : obs.windGust = obs.windSpeed ; //When it's not gusty it's the same?
-	( (*itr).HasMember("W") ) ? obs.weatherType = std::stoul( (*itr)["W"].GetString() ) : obs.weatherType = 33 ; //Slow? 33 might become used?
-	( (*itr).HasMember("P") ) ? obs.pressure = (*itr)["P"].GetString() : obs.pressure = "" ;
-	( (*itr).HasMember("Pt") ) ? obs.tendency = (*itr)["Pt"].GetString() : obs.tendency = "" ;
-	( (*itr).HasMember("Dp") ) ? obs.dewPoint = (*itr)["Dp"].GetString() : obs.dewPoint = "" ;
-	( (*itr).HasMember("H") ) ? obs.humidity = (*itr)["H"].GetString() : obs.humidity = "" ;
+	obs.weatherType = 33 ; //Stays 33 if Datapoint didn't send one. 33 might become used?
+	observation_fields.Decode(obs, *itr) ;
+	if (obs.windGust == "") { obs.windGust = obs.windSpeed ; } //When it's not gusty it's the same?
 	return obs;
 };
 
+size_t datapoint::api::DecodeForecast(const rapidjson::Value &location, forecast *buffer, size_t size) {
+	/*
+	 * Each slot is cleared and refilled in place, so strings already in the buffer keep their storage.
+	 */
+	size_t reads = 0;
+	const rapidjson::Value& days = location["Period"];
+	rapidjson::Value::ConstValueIterator d_begin = &days, d_end = &days + 1;
+	if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+	for (rapidjson::Value::ConstValueIterator d_itr = d_begin; d_itr != d_end && reads < size ; ++d_itr ) {
+		const rapidjson::Value& hours = (*d_itr)["Rep"];
+		rapidjson::Value::ConstMemberIterator date = d_itr->FindMember("value");
+		rapidjson::Value::ConstValueIterator h_begin = &hours, h_end = &hours + 1;
+		if (hours.IsArray()) { h_begin = hours.Begin(); h_end = hours.End(); }
+		for (rapidjson::Value::ConstValueIterator itr = h_begin; itr != h_end && reads < size ; ++itr ) {
+			forecast &frcst = buffer[reads++];
+			frcst.feelsLike.clear(); frcst.windGust.clear(); frcst.humidity.clear(); frcst.temperature.clear();
+			frcst.visibility.clear(); frcst.windDirection.clear(); frcst.windSpeed.clear(); frcst.uv.clear();
+			frcst.precipitationProb.clear(); frcst.minsofday.clear(); frcst.date.clear();
+			frcst.weatherType = 33 ;
+			forecast_fields.Decode(frcst, *itr) ;
+			if (date != d_itr->MemberEnd() && date->value.IsString()) { frcst.date = date->value.GetString(); }
+		}
+	}
+	return reads;
+}
+
 datapoint::forecast datapoint::api::dumpForecast(rapidjson::Value::ConstValueIterator itr) {
 	forecast frcst;
-	( (*itr).HasMember("F") ) ? frcst.feelsLike = (*itr)["F"].GetString() : frcst.feelsLike = "" ;
-	( (*itr).HasMember("G") ) ? frcst.windGust = (*itr)["G"].GetString() : frcst.windGust = "" ;
-	( (*itr).HasMember("H") ) ? frcst.humidity = (*itr)["H"].GetString() : frcst.humidity = "" ;
-	( (*itr).HasMember("T") ) ? frcst.temperature = (*itr)["T"].GetString() : frcst.temperature = "" ;
-	( (*itr).HasMember("V") ) ? frcst.visibility = (*itr)["V"].GetString() : frcst.visibility = "" ;
-	( (*itr).HasMember("D") ) ? frcst.windDirection = (*itr)["D"].GetString() : frcst.windDirection = "" ;
-	( (*itr).HasMember("S") ) ? frcst.windSpeed = (*itr)["S"].GetString() : frcst.windSpeed = "" ;
-	( (*itr).HasMember("U") ) ? frcst.uv = (*itr)["U"].GetString() : frcst.uv = "" ;
-	( (*itr).HasMember("W") ) ? frcst.weatherType = std::stoul( (*itr)["W"].GetString() ) : frcst.weatherType = 33 ;
-	( (*itr).HasMember("Pp") ) ? frcst.precipitationProb = (*itr)["Pp"].GetString() : frcst.precipitationProb = "" ;
-	frcst.minsofday = (*itr)["$"].GetString();
+	frcst.weatherType = 33 ;
+	forecast_fields.Decode(frcst, *itr) ; //Daily Reps decode too, see fields.h
 	return frcst;
 }
 
 datapoint::forecast * datapoint::api::GetForecast() {
 	/*
-	 * This currently runs though the two-dimensional days/hours array that Datapoint uses. It's a bit blind.
-	 *
-	 * It's possible to use the time of the system or first 'hour' returned to work out how many hours are
-	 * left in the first day, then pull four full days.
-	 *
-	 * TODO: There is a slight C++ issue in that the forecast array, locally defined, can not be returned outside
-	 * this function without defining the array size as static. If anyone can work around this so that the
-	 * memory allocation of the array is only that of a required amount I'd be extremely grateful for that pull
-	 * request! (I suspect the answer is something with vectors.)
+	 * Kept for older code. The array is per thread, so threads don't trample each other, but the next call on the
+	 * same thread still overwrites it. GetForecasts() or GetForecast(buffer, size) are safer.
 	 */
 	#define MAXHOURS 28 //Sometimes a bit more, but he have to define this or compile complains frcst[] isn't static.
-	static forecast frcst[MAXHOURS];
+	static thread_local forecast frcst[MAXHOURS];
 
-	rapidjson::Document json;
-	rapidjson::Value::ConstValueIterator itr = 0; //Set 0 to avoid compiler warnings.
+	size_t reads = GetForecast(frcst, MAXHOURS);
+	for (size_t i = reads; i < MAXHOURS; i++) { //Nothing left over from a longer forecast on an earlier call
+		frcst[i] = forecast();
+		frcst[i].weatherType = 33 ; //As dumpForecast
+	}
+	return frcst;
+};
 
+/*
+ * Reentrant forecasts. Nothing static is touched, so any number of api objects can do this at once on different
+ * threads. They can all share one sitelist index (see Setsites), as it's never changed once built.
+ */
+std::vector<datapoint::forecast> datapoint::api::GetForecasts() {
 	if (forecast_id == 0) {
-		json = api::Call("sitelist" , FORECAST) ;
-		itr = datapoint::api::FindNearest(&json, &lat, &lon);
-		forecast_id = std::stoul( (*itr)["id"].GetString() ) ;
-		forecast_name = (*itr)["name"].GetString() ;
-		( (*itr).HasMember("unitaryAuthArea") ) ? forecast_area = (*itr)["unitaryAuthArea"].GetString() : forecast_area = "" ;
+		Locate(FORECAST);
 	}
 
-	std::string func = to_string(forecast_id) + "?res=3hourly" ; //You can also use "?res=daily" for a Day and Night forecast.
-	json = api::Call(func , FORECAST) ;
+	return FetchForecast(forecast_id);
+}
 
-	const rapidjson::Value& days = json["SiteRep"]["DV"]["Location"]["Period"];
-	assert(days.IsArray()); //Unlike Observations, safely assume this is always an array of 4 or 5.
-	static unsigned short int reads = 0;
-	for (rapidjson::Value::ConstValueIterator d_itr = days.Begin(); d_itr != days.End() ; ++d_itr ) {
-	const rapidjson::Value& hours = (*d_itr)["Rep"];
+/*
+ * Every Rep gets a time up front but is only decoded when it's read, so a caller after the next few hours pays for
+ * just those. Daily forecasts come back as Day and Night slots.
+ */
+datapoint::forecastview datapoint::api::GetForecastView(bool daily) {
+	if (forecast_id == 0) {
+		Locate(FORECAST);
+	}
+	rapidjson::Document json = api::Call(to_string(forecast_id) + ((daily) ? "?res=daily" : "?res=3hourly") , FORECAST) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	forecastview view(std::move(json));
+	Time(metrics::FORECASTS, metrics::DECODE, start);
+	return view;
+}
+
+size_t datapoint::api::GetForecast(forecast *buffer, size_t size) {
+	if (scratch && !responses) { //Straight into the buffer, reusing its strings
+		if (forecast_id == 0) {
+			Locate(FORECAST);
+		}
+		const rapidjson::Value &json = api::Call(forecast_id, "?res=3hourly", FORECAST, *scratch) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t reads = DecodeForecast(json["SiteRep"]["DV"]["Location"], buffer, size);
+		Time(metrics::FORECASTS, metrics::DECODE, start);
+		return reads;
+	}
+	std::vector<forecast> fetched = GetForecasts();
+	size_t reads = 0;
+	for (std::vector<forecast>::iterator itr = fetched.begin(); itr != fetched.end() && reads < size; ++itr) {
+		buffer[reads] = std::move(*itr);
+		reads++;
+	}
+	return reads;
+}
+
+/*
+ * Typed versions of GetForecast and GetObservation. The DOM is decoded straight into the series' arrays without
+ * going through the string classes at all.
+ */
+void datapoint::api::GetForecast(forecastseries &series) {
+	if (forecast_id == 0) {
+		Locate(FORECAST);
+	}
+	if (scratch && !responses) {
+		const rapidjson::Value &json = api::Call(forecast_id, "?res=3hourly", FORECAST, *scratch) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		series.Decode(json);
+		Time(metrics::FORECASTS, metrics::DECODE, start);
+		return;
+	}
+	rapidjson::Document json = api::Call(to_string(forecast_id) + "?res=3hourly" , FORECAST) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	series.Decode(json);
+	Time(metrics::FORECASTS, metrics::DECODE, start);
+}
+
+void datapoint::api::GetObservation(observationseries &series) {
+	if (observation_id == 0) {
+		Locate(OBSERVATION);
+	}
+	if (scratch && !responses) {
+		const rapidjson::Value &json = api::Call(observation_id, "?res=hourly", OBSERVATION, *scratch) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		series.Decode(json);
+		Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+		return;
+	}
+	rapidjson::Document json = api::Call(to_string(observation_id) + "?res=hourly" , OBSERVATION) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	series.Decode(json);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+}
+
+/*
+ * Observation history. The response is the same 24 hours as ever, but only the hours the history hasn't seen
+ * are decoded and appended. With a cache set, an unchanged response is a 304 and nothing new is added.
+ */
+size_t datapoint::api::GetObservation(observationhistory &history) {
+	if (observation_id == 0) {
+		Locate(OBSERVATION);
+	}
+	if (scratch && !responses) {
+		const rapidjson::Value &json = api::Call(observation_id, "?res=hourly", OBSERVATION, *scratch) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t added = history.Update(json["SiteRep"]["DV"]["Location"]);
+		Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+		return added;
+	}
+	rapidjson::Document json = api::Call(to_string(observation_id) + "?res=hourly" , OBSERVATION) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t added = history.Update(json);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	return added;
+}
+
+size_t datapoint::api::GetAllObservations(historystore &store) {
+	rapidjson::Document json = api::Call("all?res=hourly" , OBSERVATION) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t added = store.Update(json);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	return added;
+}
+
+std::vector<datapoint::forecast> datapoint::api::DecodeForecast(const rapidjson::Document &json) {
+	return DecodeForecast(json["SiteRep"]["DV"]["Location"]);
+}
+
+std::vector<datapoint::forecast> datapoint::api::DecodeForecast(const rapidjson::Value &location) {
+	/*
+	 * Runs though the two-dimensional days/hours array into a vector sized by what Datapoint actually sent.
+	 */
+	std::vector<forecast> frcst;
+	const rapidjson::Value& days = location["Period"];
+	rapidjson::Value::ConstValueIterator d_begin = &days, d_end = &days + 1; //A lone Period isn't wrapped in an array
+	if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+	for (rapidjson::Value::ConstValueIterator d_itr = d_begin; d_itr != d_end ; ++d_itr ) {
+		const rapidjson::Value& hours = (*d_itr)["Rep"];
+		size_t first = frcst.size();
 		if (hours.IsArray()) {
-			assert(hours.IsArray());
-			for (itr = hours.Begin() ; itr != hours.End()  ; ++itr ) {
-				frcst[reads] = dumpForecast(itr);
-				reads++;
-				if (reads == MAXHOURS) { break; }
-				;
+			for (rapidjson::Value::ConstValueIterator itr = hours.Begin() ; itr != hours.End()  ; ++itr ) {
+				frcst.push_back(dumpForecast(itr));
 			}
 		} else {
-			itr = &hours;
-			frcst[reads] = dumpForecast(itr);
-			reads++;
-			if (reads == MAXHOURS) { break; }
+			frcst.push_back(dumpForecast(&hours));
 		}
-	if (reads == MAXHOURS) { break; }
+		rapidjson::Value::ConstMemberIterator date = d_itr->FindMember("value");
+		if (date == d_itr->MemberEnd() || !date->value.IsString()) { continue; }
+		for (size_t i = first; i < frcst.size(); i++) { frcst[i].date = date->value.GetString(); }
 	}
-
 	return frcst;
-};
+}
+
+/*
+ * Batch requests. Every coordinate is resolved against the one shared sitelist index, inputs landing on the same
+ * site are folded together, and each distinct site is then fetched exactly once.
+ */
+template <class T> datapoint::batch<T> datapoint::api::Resolve(const std::vector<coords> &where, bool isForecast) {
+	batch<T> found;
+	std::shared_ptr<const siteindex> sites = Getsites(isForecast);
+	std::unordered_map<unsigned int, size_t> seen;
+	found.lookup.reserve(where.size());
+	for (const coords &c : where) {
+		const site *nearest = sites->Nearest(c.lat, c.lon);
+		if (!nearest) {
+			Errors() << "No DataPoint site near " << c.lat << ", " << c.lon << "." << endl ;
+			throw 1;
+		}
+		unsigned int id = nearest->id;
+		std::unordered_map<unsigned int, size_t>::iterator itr = seen.find(id);
+		if (itr == seen.end()) {
+			itr = seen.emplace(id, found.ids.size()).first;
+			found.ids.push_back(id);
+		}
+		found.lookup.push_back(itr->second);
+	}
+	found.results.resize(found.ids.size());
+	return found;
+}
+
+datapoint::batch<std::vector<datapoint::forecast> > datapoint::api::GetForecasts(const std::vector<coords> &where) {
+	batch<std::vector<forecast> > found = Resolve<std::vector<forecast> >(where, FORECAST);
+	for (size_t i = 0; i < found.ids.size(); i++) {
+		found.results[i] = FetchForecast(found.ids[i]);
+	}
+	return found;
+}
+
+datapoint::batch<datapoint::observation> datapoint::api::GetObservations(const std::vector<coords> &where) {
+	batch<observation> found = Resolve<observation>(where, OBSERVATION);
+	for (size_t i = 0; i < found.ids.size(); i++) {
+		found.results[i] = FetchObservation(found.ids[i]);
+	}
+	return found;
+}
+
+/*
+ * Asynchronous versions. Requests go to a curl_multi engine (the shared one unless Setengine is called) and
+ * complete on its thread, so an observation, a forecast and both sitelists can all be in flight at once.
+ *
+ * The api object has to outlive its requests and shouldn't be used for anything else until they finish.
+ * A forecast and an observation request can run together, as they don't touch the same members.
+ */
+void datapoint::api::Setengine(std::shared_ptr<engine> inengine) {
+	loop = inengine;
+}
+
+void datapoint::api::CallAsync(std::string func, bool isForecast, std::function<void(bool ok, rapidjson::Document &json)> done) {
+	/*
+	 * Results that need no transfer are still posted to the engine, so done always runs on its thread.
+	 */
+	if (!loop) {
+		loop = engine::Shared();
+	}
+	if(key == "" || func == "") {
+		Errors() << "Couldn't create valid payload for Datapoint. Crashed instead of wasting a request." << endl ;
+		loop->Post([done]() { rapidjson::Document json; done(false, json); });
+		return;
+	}
+
+	metrics::endpoint where = metrics::Endpoint(func, isForecast);
+	time_t now = time(nullptr);
+	std::string cachekey = cache::Key(func, isForecast);
+	cacheentry cached;
+	bool haveCached = responses && responses->Get(cachekey, cached);
+	std::shared_ptr<cache> store = responses;
+	std::shared_ptr<metrics> recorder = stats;
+	if (haveCached && cached.Fresh(now)) {
+		loop->Post([recorder, where, cached, done]() {
+			rapidjson::Document json;
+			metrics::sample sample(where);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bool ok = !json.Parse(cached.body.c_str()).HasParseError();
+			sample.micros[metrics::PARSE] = metrics::Since(start);
+			sample.result = (ok) ? metrics::CACHED : metrics::FAILED;
+			if (recorder) { recorder->Record(sample); }
+			done(ok, json);
+		});
+		return;
+	}
+
+	std::ostream *report = errors;
+	engine::scheduling by; //Same fair use budget as the blocking calls, nullptr for none
+	by.queue = queue;
+	by.priority = scheduler::Priority(func, isForecast);
+	by.retrying = [recorder, where](unsigned int) { if (recorder) { recorder->Retry(where); } };
+	loop->Fetch(Url(func, isForecast), [store, recorder, report, where, cachekey, cached, haveCached, func, isForecast, done]
+			(CURLcode code, long status, std::string &body, cacheentry &received, metrics::sample &sample) mutable {
+		rapidjson::Document json;
+		sample.where = where;
+		if (code != CURLE_OK) {
+			sample.result = metrics::FAILED;
+			if (recorder) { recorder->Record(sample); }
+			if (report) {
+				*report << "Error: " << code << endl ;
+				*report << "DataPoint has not returned any data, this could be due to an incorrect API key" << endl ;
+			}
+			done(false, json);
+			return;
+		}
+		time_t now = time(nullptr);
+		if (status == 304 && haveCached) {
+			cached.fetched = now;
+			cached.expires = now + cache::TTL(func, isForecast);
+			store->Put(cachekey, cached);
+			body.swap(cached.body);
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool failed = json.Parse(body.c_str()).HasParseError();
+		sample.micros[metrics::PARSE] = metrics::Since(start);
+		sample.result = (failed) ? metrics::FAILED : (status == 304 && haveCached) ? metrics::REVALIDATED : metrics::FETCHED;
+		if (recorder) { recorder->Record(sample); }
+		if (failed) {
+			if (report) { *report << "DataPoint received invalid JSON code and could not parse it." << endl ; }
+			done(false, json);
+			return;
+		}
+		if (store && status == 200) {
+			received.body.swap(body);
+			received.fetched = now;
+			received.expires = now + cache::TTL(func, isForecast);
+			store->Put(cachekey, received);
+		}
+		done(true, json);
+	}, (haveCached) ? cached.etag : "", (haveCached) ? cached.modified : "", by);
+}
+
+void datapoint::api::LocateAsync(bool isForecast, std::function<void(bool ok)> done) {
+	/*
+	 * Locate throws when no site is near, which is reported as done(false). Like CallAsync, done is posted to
+	 * the engine when the answer is already here.
+	 */
+	if (!loop) {
+		loop = engine::Shared();
+	}
+	if ((isForecast) ? forecast_id != 0 : observation_id != 0) {
+		loop->Post([done]() { done(true); });
+		return;
+	}
+	if ((isForecast) ? forecast_sites : observation_sites) {
+		bool ok = true;
+		try { Locate(isForecast); } catch (...) { ok = false; } //Index already here, no network needed
+		loop->Post([done, ok]() { done(ok); });
+		return;
+	}
+	CallAsync("sitelist", isForecast, [this, isForecast, done](bool ok, rapidjson::Document &json) {
+		if (ok) {
+			try {
+				std::shared_ptr<siteindex> built = std::make_shared<siteindex>();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				ok = built->Build(json);
+				Time(metrics::SITELISTS, metrics::DECODE, start);
+				if (ok) {
+					(isForecast) ? forecast_sites = built : observation_sites = built ;
+					Locate(isForecast);
+				}
+			} catch (...) {
+				ok = false;
+			}
+		}
+		done(ok);
+	});
+}
+
+void datapoint::api::GetForecastAsync(std::function<void(bool ok, std::vector<forecast> &forecasts)> done) {
+	LocateAsync(FORECAST, [this, done](bool ok) {
+		if (!ok) {
+			std::vector<forecast> none;
+			done(false, none);
+			return;
+		}
+		CallAsync(to_string(forecast_id) + "?res=3hourly" , FORECAST, [this, done](bool ok, rapidjson::Document &json) {
+			std::vector<forecast> frcst;
+			if (ok) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				try { frcst = DecodeForecast(json); } catch (...) { ok = false; }
+				Time(metrics::FORECASTS, metrics::DECODE, start);
+			}
+			done(ok, frcst);
+		});
+	});
+}
+
+void datapoint::api::GetObservationAsync(std::function<void(bool ok, observation &obs)> done) {
+	LocateAsync(OBSERVATION, [this, done](bool ok) {
+		if (!ok) {
+			observation none;
+			done(false, none);
+			return;
+		}
+		CallAsync(to_string(observation_id) + "?res=hourly" , OBSERVATION, [this, done](bool ok, rapidjson::Document &json) {
+			observation obs;
+			if (ok) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				try { obs = DecodeObservation(json); } catch (...) { ok = false; }
+				Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+			}
+			done(ok, obs);
+		});
+	});
+}
+
+/*
+ * Future flavours. get() throws 1, same as the blocking calls, if anything went wrong.
+ */
+std::future<std::vector<datapoint::forecast> > datapoint::api::GetForecastAsync() {
+	std::shared_ptr<std::promise<std::vector<forecast> > > promise = std::make_shared<std::promise<std::vector<forecast> > >();
+	GetForecastAsync([promise](bool ok, std::vector<forecast> &forecasts) {
+		(ok) ? promise->set_value(std::move(forecasts)) : promise->set_exception(std::make_exception_ptr(1));
+	});
+	return promise->get_future();
+}
+
+std::future<datapoint::observation> datapoint::api::GetObservationAsync() {
+	std::shared_ptr<std::promise<observation> > promise = std::make_shared<std::promise<observation> >();
+	GetObservationAsync([promise](bool ok, observation &obs) {
+		(ok) ? promise->set_value(std::move(obs)) : promise->set_exception(std::make_exception_ptr(1));
+	});
+	return promise->get_future();
+}
+
+/*
+ * Bulk "all sites" requests. One call returns every site, and the Location array is split into even slices
+ * that are decoded in parallel. The DOM is only read, so the workers don't need to lock anything.
+ *
+ * threads = 0 uses one per core.
+ */
+template <class T> datapoint::sitestore<T> datapoint::api::DecodeAll(const rapidjson::Document &json, unsigned int threads,
+		T (datapoint::api::*decode)(const rapidjson::Value &location)) {
+	sitestore<T> store;
+	const rapidjson::Value& locations = json["SiteRep"]["DV"]["Location"];
+	const rapidjson::Value *begin = &locations, *end = &locations + 1;
+	if (locations.IsArray()) { begin = locations.Begin(); end = locations.End(); }
+	size_t count = end - begin;
+
+	std::vector<unsigned int> ids(count);
+	std::vector<T> results(count);
+	if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+	if (threads > count) { threads = std::max<size_t>(1, count); }
+
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> failed(threads);
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			try {
+				for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+					const rapidjson::Value& location = begin[i];
+					ids[i] = std::stoul( location["i"].GetString() );
+					if (location.HasMember("Period")) { //Sites that have gone quiet come back with no data at all
+						results[i] = (this->*decode)(location);
+					}
+				}
+			} catch (...) {
+				failed[t] = std::current_exception();
+			}
+		});
+	}
+	for (std::thread &worker : workers) { worker.join(); }
+	for (std::exception_ptr &e : failed) {
+		if (e) { std::rethrow_exception(e); }
+	}
+
+	std::vector<size_t> order(count);
+	for (size_t i = 0; i < count; i++) { order[i] = i; }
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ids[a] < ids[b]; });
+	store.ids.reserve(count);
+	store.results.reserve(count);
+	for (size_t i : order) {
+		store.ids.push_back(ids[i]);
+		store.results.push_back(std::move(results[i]));
+	}
+	return store;
+}
+
+datapoint::sitestore<std::vector<datapoint::forecast> > datapoint::api::GetAllForecasts(unsigned int threads) {
+	rapidjson::Document json = api::Call("all?res=3hourly" , FORECAST) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	sitestore<std::vector<forecast> > store = DecodeAll<std::vector<forecast> >(json, threads, &api::DecodeForecast);
+	Time(metrics::FORECASTS, metrics::DECODE, start);
+	return store;
+}
+
+datapoint::sitestore<datapoint::observation> datapoint::api::GetAllObservations(unsigned int threads) {
+	rapidjson::Document json = api::Call("all?res=hourly" , OBSERVATION) ;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	sitestore<observation> store = DecodeAll<observation>(json, threads, &api::DecodeObservation);
+	Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	return store;
+}
+
+/*
+ * Bulk export. Without a cache the response is parsed as it downloads and each Rep is written as soon as it's
+ * parsed, so rows are going out while the transfer is still running and there's never a full body or a DOM in
+ * memory. A cache needs the whole body to keep, so with one set it's fetched through Call and written from the
+ * DOM site by site. Either way the exporter is flushed before returning.
+ */
+size_t datapoint::api::ExportAllForecasts(exporter &out, bool daily) {
+	std::string func = (daily) ? "all?res=daily" : "all?res=3hourly" ;
+	size_t rows;
+	if (!responses) {
+		exporthandler<forecastrecord> handler(&out);
+		api::Stream(func, FORECAST, handler) ;
+		rows = handler.rows;
+	} else {
+		rapidjson::Document json = api::Call(func , FORECAST) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		rows = out.Forecasts(json);
+		Time(metrics::FORECASTS, metrics::DECODE, start);
+	}
+	if (!out.Flush()) {
+		Errors() << "Couldn't write the forecast export." << endl ;
+		throw 1;
+	}
+	return rows;
+}
+
+size_t datapoint::api::ExportAllObservations(exporter &out) {
+	size_t rows;
+	if (!responses) {
+		exporthandler<observationrecord> handler(&out);
+		api::Stream("all?res=hourly", OBSERVATION, handler) ;
+		rows = handler.rows;
+	} else {
+		rapidjson::Document json = api::Call("all?res=hourly" , OBSERVATION) ;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		rows = out.Observations(json);
+		Time(metrics::OBSERVATIONS, metrics::DECODE, start);
+	}
+	if (!out.Flush()) {
+		Errors() << "Couldn't write the observation export." << endl ;
+		throw 1;
+	}
+	return rows;
+}
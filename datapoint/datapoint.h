@@ -6,10 +6,17 @@
  */
 
 
-#ifndef DATAPOINT_DATAPOINT_H_H_
-#define DATAPOINT_DATAPOINT_H_T_H_
+#ifndef DATAPOINT_DATAPOINT_H_
+#define DATAPOINT_DATAPOINT_H_
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
 #include <vector>
 
 struct curlbuffer
@@ -19,7 +26,22 @@ struct curlbuffer
 };
 
 #include <rapidjson/document.h>
+#include "async.h"
+#include "cache.h"
+#include "connection.h"
+#include "exporter.h"
+#include "forecastview.h"
+#include "grid.h"
+#include "history.h"
+#include "mapped.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "siteindex.h"
+#include "typed.h"
+#include "workspace.h"
 namespace datapoint {
+		class recordhandler;
+		class refresher;
 		class forecast {
 			public:
 				std::string feelsLike; //Celsius
@@ -33,6 +55,7 @@ namespace datapoint {
 				unsigned short int weatherType; //Ref weather_codes
 				std::string precipitationProb; //Percent
 				std::string minsofday;
+				std::string date; //The Period's, as Datapoint sends it: "2019-03-07Z". minsofday counts from its UTC midnight.
 		} ;//forecast
 		class observation {
 			public:
@@ -47,28 +70,123 @@ namespace datapoint {
 				std::string dewPoint; //Celsius
 				std::string humidity; //Percent
 		} ;//observation
+		class coords {
+			public:
+				double lat;
+				double lon;
+		} ;//coords
+		template <class T> class batch {
+			/*
+			 * Results of a multi-location request. Each distinct site is fetched and stored once, and every input
+			 * maps back to its site through 'lookup', so batch[i] is the answer for the i'th coords given.
+			 */
+			public:
+				std::vector<unsigned int> ids; //Distinct site IDs, in the order they were first seen
+				std::vector<T> results; //Same order as ids
+				std::vector<size_t> lookup; //One per input, index into ids/results
+				const T & operator[](size_t input) const { return results[lookup[input]]; }
+				unsigned int id(size_t input) const { return ids[lookup[input]]; }
+				size_t size() const { return lookup.size(); }
+		} ;//batch
+		template <class T> class sitestore {
+			/*
+			 * Results of an "all sites" request, sorted by site ID.
+			 */
+			public:
+				std::vector<unsigned int> ids;
+				std::vector<T> results; //Same order as ids
+				size_t size() const { return ids.size(); }
+				const T * Find(unsigned int id) const {
+					std::vector<unsigned int>::const_iterator itr = std::lower_bound(ids.begin(), ids.end(), id);
+					return (itr == ids.end() || *itr != id) ? nullptr : &results[itr - ids.begin()];
+				}
+		} ;//sitestore
 		class api {
+			friend class refresher; //Fetches subscribed sites by ID
 			private:
-				const char* url_forecast = "http://datapoint.metoffice.gov.uk/public/data/val/wxfcs/all/json" ;
-				const char* url_obs =      "http://datapoint.metoffice.gov.uk/public/data/val/wxobs/all/json" ;
+				std::string url_base = "http://datapoint.metoffice.gov.uk/public/data/val" ; //Point elsewhere with Seturl
+				const char* url_forecast = "/wxfcs/all/json" ;
+				const char* url_obs =      "/wxobs/all/json" ;
+				std::shared_ptr<connectionpool> pool = connectionpool::Shared();
+				std::shared_ptr<cache> responses; //No cache unless Setcache is called
+				bool streaming = false;
+				std::shared_ptr<workspace> scratch; //Only with Setworkspace(true)
+				std::shared_ptr<metrics> stats = std::make_shared<metrics>(); //Per api object unless Setmetrics shares one
+				std::shared_ptr<scheduler> queue = scheduler::Shared();
+				std::ostream *errors = &std::cout; //Where failures are reported, see Seterrors
+				std::ostream & Errors() ;
+				scheduler::response Perform(const std::string &payload, const std::string &etag, const std::string &modified,
+						metrics::sample &sample) ;
+				void Record(const metrics::sample &sample) ;
+				void Time(metrics::endpoint where, metrics::phase what, std::chrono::steady_clock::time_point start) ;
+				rapidjson::Document Parse(const std::string &body, metrics::sample &sample) ;
+				std::string Url(std::string func, bool isForecast) ;
+				void Stream(std::string func, bool isForecast, recordhandler &handler) ;
+				const rapidjson::Value & Call(unsigned int id, const char *query, bool isForecast, workspace &into) ;
+				std::vector<datapoint::forecast> FetchForecast(unsigned int id) ;
+				void Locate(bool isForecast) ;
+				std::shared_ptr<engine> loop; //For the Async calls, engine::Shared() unless Setengine is called
+				void CallAsync(std::string func, bool isForecast, std::function<void(bool ok, rapidjson::Document &json)> done) ;
+				void LocateAsync(bool isForecast, std::function<void(bool ok)> done) ;
+				datapoint::observation FetchObservation(unsigned int id) ;
 				std::string key;
 				double lat;
 				double lon;
-				long double Distance(long double lat1, long double long1, long double lat2, long double long2 );
-				rapidjson::Value::ConstValueIterator FindNearest(rapidjson::Document *json, double *our_lat, double *our_lon);
 				datapoint::forecast dumpForecast(rapidjson::Value::ConstValueIterator itr);
+				std::shared_ptr<const siteindex> forecast_sites; //Built from the first sitelist call, or loaded/shared
+				std::shared_ptr<const siteindex> observation_sites;
+				template <class T> batch<T> Resolve(const std::vector<coords> &where, bool isForecast);
+				template <class T> sitestore<T> DecodeAll(const rapidjson::Document &json, unsigned int threads,
+						T (datapoint::api::*decode)(const rapidjson::Value &location));
 			public:
 				unsigned int forecast_id = 0;
 				std::string forecast_name;
 				std::string forecast_area;
-				unsigned short int observation_id = 0;
+				unsigned int observation_id = 0;
 				std::string observation_name;
 				std::string observation_area;
 				rapidjson::Document Call(std::string func, bool forecast) ;
 				std::string Setkey(std::string inkey); std::string Setkey();
+				std::string Seturl(std::string inurl); std::string Seturl(); //Base URL, up to and including '/val'
+				void Setpool(std::shared_ptr<connectionpool> inpool) ;
+				void Setcache(std::string directory) ; void Setcache(std::shared_ptr<cache> incache) ;
+				void Setengine(std::shared_ptr<engine> inengine) ;
+				void Setscheduler(std::shared_ptr<scheduler> inscheduler) ; //nullptr for no coalescing, rate limit or retries
+				void Setmetrics(std::shared_ptr<metrics> inmetrics) ; //nullptr turns recording off
+				std::shared_ptr<metrics> Getmetrics() ;
+				void Seterrors(std::ostream *inerrors) ; //cout by default, nullptr turns error printing off
+				void Setstreaming(bool instreaming) ; //Parse while downloading. Ignored when a cache is set.
+				void Setworkspace(bool inreuse) ; //Reuse buffers and a JSON arena between calls. Ignored when a cache is set.
 				bool Setlocation(double our_lat, double our_lon) ;
-				datapoint::forecast * GetForecast() ;
+				std::shared_ptr<const siteindex> Getsites(bool isForecast) ; //Calls 'sitelist' only if we have no index yet
+				void Setsites(std::shared_ptr<const siteindex> sites, bool isForecast) ; //Must have sites. nullptr gets the sitelist again.
+				bool Loadsites(std::string path, bool isForecast) ;
+				bool Savesites(std::string path, bool isForecast) ;
+				bool Savesnapshot(std::string path) ; //Both sitelists and every site's forecasts and observations, for mappedsnapshot
+				datapoint::forecast * GetForecast() ; //Overwritten by the next call on the same thread
+				std::vector<datapoint::forecast> GetForecasts() ; //Owned, every forecast Datapoint sent
+				forecastview GetForecastView(bool daily = false) ; //Decoded as it's read, by time. See forecastview.h
+				size_t GetForecast(datapoint::forecast *buffer, size_t size) ; //Fills up to size, returns how many
 				datapoint::observation GetObservation() ;
+				void GetForecast(forecastseries &series) ; //Typed, appended to series
+				void GetObservation(observationseries &series) ; //Typed, the whole 24 hours Datapoint sends
+				size_t GetObservation(observationhistory &history) ; //Adds hours newer than history holds, returns how many
+				size_t GetAllObservations(historystore &store) ; //Same, for every site
+				std::future<std::vector<datapoint::forecast> > GetForecastAsync() ;
+				std::future<datapoint::observation> GetObservationAsync() ;
+				void GetForecastAsync(std::function<void(bool ok, std::vector<datapoint::forecast> &forecasts)> done) ; //Runs on the engine thread
+				void GetObservationAsync(std::function<void(bool ok, datapoint::observation &obs)> done) ;
+				batch<std::vector<datapoint::forecast> > GetForecasts(const std::vector<coords> &where) ;
+				batch<datapoint::observation> GetObservations(const std::vector<coords> &where) ;
+				sitestore<std::vector<datapoint::forecast> > GetAllForecasts(unsigned int threads = 0) ; //Every site in one call
+				sitestore<datapoint::observation> GetAllObservations(unsigned int threads = 0) ;
+				size_t ExportAllForecasts(exporter &out, bool daily = false) ; //Every site's Reps, written as they're decoded
+				size_t ExportAllObservations(exporter &out) ;
+				std::vector<datapoint::forecast> DecodeForecast(const rapidjson::Document &json) ;
+				std::vector<datapoint::forecast> DecodeForecast(const rapidjson::Value &location) ; //One SiteRep Location
+				size_t DecodeForecast(const rapidjson::Value &location, datapoint::forecast *buffer, size_t size) ; //Fills up to size
+				datapoint::observation DecodeObservation(const rapidjson::Document &json) ;
+				datapoint::observation DecodeObservation(const rapidjson::Value &location) ;
 				std::string weather_codes[32] = { //Use designators for readability...
 					[0] = "Clear night",
 					[1] = "Sunny day",
@@ -109,4 +227,4 @@ namespace datapoint {
 		} ;//api
 } //datapoint
 
-#endif /* DATAPOINT_DATAPOINT_H_INT_H_ */
+#endif /* DATAPOINT_DATAPOINT_H_ */
@@ -0,0 +1,234 @@
+/*
+ * DataPoint for C++
+ *
+ * NDJSON and CSV export, see exporter.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/exporter.h"
+#include "../datapoint/datapoint.h"
+#include "../datapoint/fields.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+static const char *forecast_header = "site,time,temperature,feelsLike,windSpeed,windGust,windDirection,humidity,"
+		"precipitationProb,uv,visibility,weatherType\n";
+static const char *observation_header = "site,time,temperature,dewPoint,humidity,pressure,tendency,windSpeed,windGust,"
+		"windDirection,visibility,weatherType\n";
+
+datapoint::exporter::exporter(FILE *inout, format instyle, size_t capacity) : out(inout), style(instyle) {
+	buffer.resize(max(capacity, (size_t)EXPORT_ROW_MAX * 2));
+}
+
+datapoint::exporter::~exporter() {
+	Flush();
+	if (owned) { fclose(out); }
+}
+
+bool datapoint::exporter::Open(const std::string &path) {
+	FILE *opened = fopen(path.c_str(), "wb");
+	if (!opened) { return false; }
+	Flush(); //Anything already written belongs to the old file
+	if (owned) { fclose(out); }
+	out = opened;
+	owned = true;
+	last = NOROWS;
+	return true;
+}
+
+bool datapoint::exporter::Flush() {
+	if (used > 0 && !failed) {
+		failed = fwrite(buffer.data(), 1, used, out) != used;
+	}
+	used = 0;
+	if (!failed) { failed = fflush(out) != 0; }
+	return !failed;
+}
+
+void datapoint::exporter::Begin(rows kind) {
+	if (used + EXPORT_ROW_MAX * 2 > buffer.size()) { Flush(); } //A header and a row always fit after this
+	at = buffer.data() + used;
+	if (style == CSV && kind != last) { Text((kind == FORECASTROWS) ? forecast_header : observation_header); }
+	last = kind;
+	if (style == NDJSON) { Text((kind == FORECASTROWS) ? "{\"type\":\"forecast\"" : "{\"type\":\"observation\""); }
+}
+
+void datapoint::exporter::End() {
+	if (style == NDJSON) { *at++ = '}'; }
+	*at++ = '\n';
+	used = at - buffer.data();
+	written++;
+}
+
+void datapoint::exporter::Text(const char *str) {
+	size_t length = strlen(str);
+	memcpy(at, str, length);
+	at += length;
+}
+
+void datapoint::exporter::Key(const char *name) {
+	if (style == CSV) {
+		*at++ = ',';
+		return;
+	}
+	*at++ = ',';
+	*at++ = '"';
+	Text(name);
+	*at++ = '"';
+	*at++ = ':';
+}
+
+/*
+ * Zero padded, most significant digit first.
+ */
+static char * Digits(char *at, unsigned long value, int width) {
+	for (int i = width - 1; i >= 0; i--) {
+		at[i] = '0' + value % 10;
+		value /= 10;
+	}
+	return at + width;
+}
+
+void datapoint::exporter::Time(time_t when) {
+	/*
+	 * The inverse of DaysFromCivil in typed.cpp, so no gmtime and no locale.
+	 */
+	long days = (long)(when / 86400), seconds = (long)(when % 86400);
+	if (seconds < 0) { seconds += 86400; days--; }
+	days += 719468;
+	long era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned long doe = (unsigned long)(days - era * 146097);
+	unsigned long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned long mp = (5 * doy + 2) / 153;
+	unsigned long day = doy - (153 * mp + 2) / 5 + 1, month = (mp < 10) ? mp + 3 : mp - 9;
+	long year = (long)yoe + era * 400 + (month <= 2);
+
+	if (style == NDJSON) { *at++ = '"'; }
+	at = Digits(at, year, 4); *at++ = '-';
+	at = Digits(at, month, 2); *at++ = '-';
+	at = Digits(at, day, 2); *at++ = 'T';
+	at = Digits(at, seconds / 3600, 2); *at++ = ':';
+	at = Digits(at, seconds / 60 % 60, 2); *at++ = ':';
+	at = Digits(at, seconds % 60, 2); *at++ = 'Z';
+	if (style == NDJSON) { *at++ = '"'; }
+}
+
+template <class T> void datapoint::exporter::Number(const char *name, T value, bool have) {
+	Key(name);
+	if (!have) {
+		if (style == NDJSON) { Text("null"); }
+		return;
+	}
+	if constexpr (sizeof(T) == 1) {
+		at = to_chars(at, at + 32, (int)value).ptr; //Not as a character
+	} else {
+		at = to_chars(at, at + 32, value).ptr; //Shortest form that reads back the same, for floats
+	}
+}
+
+void datapoint::exporter::Code(const char *name, const char *code, bool have) {
+	Key(name);
+	if (!have) {
+		if (style == NDJSON) { Text("null"); }
+		return;
+	}
+	if (style == NDJSON) { *at++ = '"'; }
+	Text(code);
+	if (style == NDJSON) { *at++ = '"'; }
+}
+
+void datapoint::exporter::Write(unsigned int site, time_t when, const forecastrecord &record) {
+	Begin(FORECASTROWS);
+	if (style == NDJSON) { Text(",\"site\":"); }
+	at = to_chars(at, at + 16, site).ptr;
+	Key("time");
+	Time(when);
+	Number("temperature", record.temperature, record.Has(forecastrecord::TEMPERATURE));
+	Number("feelsLike", record.feelsLike, record.Has(forecastrecord::FEELSLIKE));
+	Number("windSpeed", record.windSpeed, record.Has(forecastrecord::WINDSPEED));
+	Number("windGust", record.windGust, record.Has(forecastrecord::WINDGUST));
+	Code("windDirection", CodeName(record.windDirection), record.Has(forecastrecord::WINDDIRECTION));
+	Number("humidity", record.humidity, record.Has(forecastrecord::HUMIDITY));
+	Number("precipitationProb", record.precipitationProb, record.Has(forecastrecord::PRECIPITATION));
+	Number("uv", record.uv, record.Has(forecastrecord::UV));
+	Code("visibility", CodeName(record.visibility), record.Has(forecastrecord::VISIBILITY));
+	Number("weatherType", record.weatherType, record.Has(forecastrecord::WEATHERTYPE));
+	End();
+}
+
+void datapoint::exporter::Write(unsigned int site, time_t when, const observationrecord &record) {
+	Begin(OBSERVATIONROWS);
+	if (style == NDJSON) { Text(",\"site\":"); }
+	at = to_chars(at, at + 16, site).ptr;
+	Key("time");
+	Time(when);
+	Number("temperature", record.temperature, record.Has(observationrecord::TEMPERATURE));
+	Number("dewPoint", record.dewPoint, record.Has(observationrecord::DEWPOINT));
+	Number("humidity", record.humidity, record.Has(observationrecord::HUMIDITY));
+	Number("pressure", record.pressure, record.Has(observationrecord::PRESSURE));
+	Code("tendency", CodeName(record.tendency), record.Has(observationrecord::TENDENCY));
+	Number("windSpeed", record.windSpeed, record.Has(observationrecord::WINDSPEED));
+	Number("windGust", record.windGust, record.Has(observationrecord::WINDGUST));
+	Code("windDirection", CodeName(record.windDirection), record.Has(observationrecord::WINDDIRECTION));
+	Number("visibility", record.visibility, record.Has(observationrecord::VISIBILITY));
+	Number("weatherType", record.weatherType, record.Has(observationrecord::WEATHERTYPE));
+	End();
+}
+
+static void DecodeRep(datapoint::forecastrecord &record, const rapidjson::Value &rep) {
+	datapoint::forecastrecord_fields.Decode(record, rep);
+}
+static void DecodeRep(datapoint::observationrecord &record, const rapidjson::Value &rep) {
+	datapoint::observationrecord_fields.Decode(record, rep);
+}
+
+/*
+ * Location, Period and Rep can each be a lone object rather than an array, so all three are walked the same way.
+ */
+template <class Record> static size_t WriteReps(datapoint::exporter &out, const rapidjson::Value &json) {
+	if (!json.IsObject() || !json.HasMember("SiteRep") || !json["SiteRep"].HasMember("DV")
+			|| !json["SiteRep"]["DV"].HasMember("Location")) {
+		return 0;
+	}
+	size_t rows = 0;
+	const rapidjson::Value& locations = json["SiteRep"]["DV"]["Location"];
+	const rapidjson::Value *l_begin = &locations, *l_end = &locations + 1;
+	if (locations.IsArray()) { l_begin = locations.Begin(); l_end = locations.End(); }
+	for (const rapidjson::Value *location = l_begin; location != l_end; ++location) {
+		if (!location->HasMember("i") || !location->HasMember("Period")) { continue; } //Quiet sites send no Period
+		unsigned int site = strtoul((*location)["i"].GetString(), NULL, 10);
+
+		const rapidjson::Value& days = (*location)["Period"];
+		const rapidjson::Value *d_begin = &days, *d_end = &days + 1;
+		if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+		for (const rapidjson::Value *day = d_begin; day != d_end; ++day) {
+			time_t midnight;
+			if (!day->HasMember("value") || !day->HasMember("Rep")) { continue; }
+			const rapidjson::Value& value = (*day)["value"];
+			if (!datapoint::ParseDate(value.GetString(), value.GetStringLength(), midnight)) { continue; }
+
+			const rapidjson::Value& reps = (*day)["Rep"];
+			const rapidjson::Value *r_begin = &reps, *r_end = &reps + 1;
+			if (reps.IsArray()) { r_begin = reps.Begin(); r_end = reps.End(); }
+			for (const rapidjson::Value *rep = r_begin; rep != r_end; ++rep) {
+				Record record;
+				DecodeRep(record, *rep);
+				out.Write(site, midnight + record.minsofday * 60, record);
+				rows++;
+			}
+		}
+	}
+	return rows;
+}
+
+size_t datapoint::exporter::Forecasts(const rapidjson::Value &json) { return WriteReps<forecastrecord>(*this, json); }
+size_t datapoint::exporter::Observations(const rapidjson::Value &json) { return WriteReps<observationrecord>(*this, json); }
@@ -0,0 +1,78 @@
+/*
+ * DataPoint for C++
+ *
+ * Bulk export of decoded forecasts and observations as NDJSON or CSV, one row per Rep, for loading into other
+ * tools. Rows are decoded Rep by Rep straight into the exporter's own buffer, which goes out in large writes when
+ * it fills. api's ExportAll calls feed it from the streaming parser (exporthandler, see stream.h), so rows leave
+ * while the download is still running. Forecasts and Observations below write from an already parsed DOM.
+ * Numbers and times are formatted with std::to_chars and by hand, never by iostreams, so the output doesn't
+ * depend on the locale and there's no flush per line.
+ *
+ * Rows have the site ID, the Rep's time as UTC ISO 8601, then the typed record's fields under the same names.
+ * Anything Datapoint didn't send is null in NDJSON and empty in CSV. Compass points, visibility and pressure
+ * tendency are written as Datapoint's codes.
+ *
+ */
+
+#ifndef DATAPOINT_EXPORTER_H_
+#define DATAPOINT_EXPORTER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "typed.h"
+
+#define EXPORT_BUFFER (256 * 1024) //Bytes gathered before each write
+#define EXPORT_ROW_MAX 512 //Bytes one row can take, with room to spare
+
+namespace datapoint {
+		class exporter {
+			/*
+			 * CSV gets a header line before its first row. A CSV file should only hold one kind of row. If the kind
+			 * changes anyway, a new header line is written before the first row of the new kind.
+			 */
+			public:
+				enum format : uint8_t { NDJSON, CSV };
+			private:
+				enum rows : uint8_t { NOROWS, FORECASTROWS, OBSERVATIONROWS };
+				FILE *out;
+				bool owned = false;
+				bool failed = false;
+				format style;
+				rows last = NOROWS;
+				std::vector<char> buffer;
+				size_t used = 0;
+				unsigned long long written = 0;
+				char *at = nullptr; //Where the row being formatted has got to
+				void Begin(rows kind); //Makes room for a row and starts it, with its header first if needed
+				void End();
+				void Text(const char *str);
+				void Key(const char *name);
+				void Time(time_t when);
+				template <class T> void Number(const char *name, T value, bool have);
+				void Code(const char *name, const char *code, bool have);
+			public:
+				exporter(FILE *inout = stdout, format instyle = NDJSON, size_t capacity = EXPORT_BUFFER);
+				~exporter(); //Flushes, and closes the file if Open opened it
+				exporter(const exporter &) = delete;
+				exporter & operator=(const exporter &) = delete;
+				bool Open(const std::string &path); //Writes to this file instead, truncated
+				bool Flush(); //False if any write so far has failed
+				unsigned long long Rows() const { return written; }
+				void Write(unsigned int site, time_t when, const forecastrecord &record);
+				void Write(unsigned int site, time_t when, const observationrecord &record);
+				/*
+				 * Every Rep of a whole response, one site or all of them. Sites without a Period are skipped. Each row
+				 * goes into the buffer as soon as it's decoded. Returns the number of rows.
+				 */
+				size_t Forecasts(const rapidjson::Value &json);
+				size_t Observations(const rapidjson::Value &json);
+		} ;//exporter
+} //datapoint
+
+#endif /* DATAPOINT_EXPORTER_H_ */
@@ -0,0 +1,198 @@
+/*
+ * DataPoint for C++
+ *
+ * Datapoint parameter codes ("T", "Pp", "Dm" ...) mapped to record fields, one table per record type. Each table
+ * is turned into a lookup at compile time, so decoding a Rep is a single pass over its members with one small
+ * array index per key. Both the DOM decoders and the streaming handlers use these tables. A new parameter or
+ * resolution only needs a new line in the table.
+ *
+ */
+
+#ifndef DATAPOINT_FIELDS_H_
+#define DATAPOINT_FIELDS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <rapidjson/document.h>
+
+#include "datapoint.h"
+
+#define FIELD_SLOTS 64 //Keys hash into this many slots. The tables are checked for clashes when they're built.
+
+namespace datapoint {
+		template <class Record> class fieldcode {
+			public:
+				const char *code;
+				bool (*set)(Record &record, const char *str, size_t length); //False if the value didn't parse
+		} ;//fieldcode
+		constexpr size_t FieldLength(const char *code) {
+			size_t length = 0;
+			while (code[length] != '\0') { length++; }
+			return length;
+		}
+		constexpr size_t FieldSlot(const char *key, size_t length) { //FIELD_SLOTS for keys no table can hold
+			if (length == 0 || length > 3) { return FIELD_SLOTS; }
+			unsigned int hash = length;
+			for (size_t i = 0; i < length; i++) { hash = hash * 27 + (unsigned char)key[i]; }
+			return hash % FIELD_SLOTS;
+		}
+		template <class Record, size_t N> class fieldtable {
+			public:
+				fieldcode<Record> fields[N];
+				int8_t slots[FIELD_SLOTS];
+				bool unique = true; //No two codes share a slot, static_assert'd on every table
+				constexpr fieldtable(const fieldcode<Record> (&table)[N]) : fields(), slots() {
+					for (size_t s = 0; s < FIELD_SLOTS; s++) { slots[s] = -1; }
+					for (size_t i = 0; i < N; i++) {
+						fields[i] = table[i];
+						size_t slot = FieldSlot(table[i].code, FieldLength(table[i].code));
+						if (slot >= FIELD_SLOTS || slots[slot] != -1) { unique = false; continue; }
+						slots[slot] = (int8_t)i;
+					}
+				}
+				const fieldcode<Record> * Find(const char *key, size_t length) const {
+					size_t slot = FieldSlot(key, length);
+					if (slot >= FIELD_SLOTS || slots[slot] < 0) { return nullptr; }
+					const fieldcode<Record> &field = fields[slots[slot]];
+					for (size_t i = 0; i < length; i++) {
+						if (field.code[i] != key[i]) { return nullptr; }
+					}
+					return (field.code[length] == '\0') ? &field : nullptr;
+				}
+				bool Set(Record &record, const char *key, size_t keyLength, const char *str, size_t length) const {
+					const fieldcode<Record> *field = Find(key, keyLength);
+					return field && field->set(record, str, length);
+				}
+				void Decode(Record &record, const rapidjson::Value &rep) const { //Every member of one Rep, in one pass
+					for (rapidjson::Value::ConstMemberIterator itr = rep.MemberBegin(); itr != rep.MemberEnd(); ++itr) {
+						if (itr->value.IsString()) {
+							Set(record, itr->name.GetString(), itr->name.GetStringLength(), itr->value.GetString(), itr->value.GetStringLength());
+						}
+					}
+				}
+		} ;//fieldtable
+
+		/*
+		 * Setters the tables point at. Text copies the string as is, for the string classes. Typed parses into a
+		 * number or enum and clears the field's bit of 'missing' if that worked.
+		 */
+		template <class Record, std::string Record::*member> bool Text(Record &record, const char *str, size_t length) {
+			(record.*member).assign(str, length);
+			return true;
+		}
+		template <class Record, unsigned short int Record::*member> bool Code(Record &record, const char *str, size_t length) {
+			uint16_t value;
+			if (!ParseNumber(str, length, value)) { return false; }
+			record.*member = value;
+			return true;
+		}
+		template <class Record, class T, T Record::*member, uint16_t bit> bool Typed(Record &record, const char *str, size_t length) {
+			bool parsed;
+			if constexpr (std::is_enum<T>::value) {
+				parsed = ParseCode(str, length, record.*member);
+			} else {
+				parsed = ParseNumber(str, length, record.*member);
+			}
+			if (parsed) { record.missing &= ~bit; }
+			return parsed;
+		}
+		template <class Record> bool Minutes(Record &record, const char *str, size_t length) {
+			//Minutes after midnight. Daily responses say Day or Night instead, kept as the start of each half of the day.
+			if (length == 3 && memcmp(str, "Day", 3) == 0) { record.minsofday = 0; return true; }
+			if (length == 5 && memcmp(str, "Night", 5) == 0) { record.minsofday = 720; return true; }
+			return ParseNumber(str, length, record.minsofday);
+		}
+
+		/*
+		 * 3 hourly and daily forecasts share a table. The daily codes are the day's maximum/noon or the night's
+		 * minimum/midnight version of a 3 hourly one, so they land in the same field.
+		 */
+		constexpr fieldcode<forecast> forecast_codes[] = {
+			{ "F", Text<forecast, &forecast::feelsLike> },
+			{ "FDm", Text<forecast, &forecast::feelsLike> },
+			{ "FNm", Text<forecast, &forecast::feelsLike> },
+			{ "G", Text<forecast, &forecast::windGust> },
+			{ "Gn", Text<forecast, &forecast::windGust> },
+			{ "Gm", Text<forecast, &forecast::windGust> },
+			{ "H", Text<forecast, &forecast::humidity> },
+			{ "Hn", Text<forecast, &forecast::humidity> },
+			{ "Hm", Text<forecast, &forecast::humidity> },
+			{ "T", Text<forecast, &forecast::temperature> },
+			{ "Dm", Text<forecast, &forecast::temperature> },
+			{ "Nm", Text<forecast, &forecast::temperature> },
+			{ "V", Text<forecast, &forecast::visibility> },
+			{ "D", Text<forecast, &forecast::windDirection> },
+			{ "S", Text<forecast, &forecast::windSpeed> },
+			{ "U", Text<forecast, &forecast::uv> },
+			{ "W", Code<forecast, &forecast::weatherType> },
+			{ "Pp", Text<forecast, &forecast::precipitationProb> },
+			{ "PPd", Text<forecast, &forecast::precipitationProb> },
+			{ "PPn", Text<forecast, &forecast::precipitationProb> },
+			{ "$", Text<forecast, &forecast::minsofday> }
+		};
+		constexpr fieldtable<forecast, sizeof(forecast_codes) / sizeof(forecast_codes[0])> forecast_fields(forecast_codes);
+		static_assert(forecast_fields.unique, "Two forecast codes hash to the same slot, change FieldSlot");
+
+		constexpr fieldcode<observation> observation_codes[] = {
+			{ "G", Text<observation, &observation::windGust> },
+			{ "T", Text<observation, &observation::temperature> },
+			{ "V", Text<observation, &observation::visibility> },
+			{ "D", Text<observation, &observation::windDirection> },
+			{ "S", Text<observation, &observation::windSpeed> },
+			{ "W", Code<observation, &observation::weatherType> },
+			{ "P", Text<observation, &observation::pressure> },
+			{ "Pt", Text<observation, &observation::tendency> },
+			{ "Dp", Text<observation, &observation::dewPoint> },
+			{ "H", Text<observation, &observation::humidity> }
+		};
+		constexpr fieldtable<observation, sizeof(observation_codes) / sizeof(observation_codes[0])> observation_fields(observation_codes);
+		static_assert(observation_fields.unique, "Two observation codes hash to the same slot, change FieldSlot");
+
+		constexpr fieldcode<forecastrecord> forecastrecord_codes[] = {
+			{ "F", Typed<forecastrecord, int8_t, &forecastrecord::feelsLike, forecastrecord::FEELSLIKE> },
+			{ "FDm", Typed<forecastrecord, int8_t, &forecastrecord::feelsLike, forecastrecord::FEELSLIKE> },
+			{ "FNm", Typed<forecastrecord, int8_t, &forecastrecord::feelsLike, forecastrecord::FEELSLIKE> },
+			{ "G", Typed<forecastrecord, uint8_t, &forecastrecord::windGust, forecastrecord::WINDGUST> },
+			{ "Gn", Typed<forecastrecord, uint8_t, &forecastrecord::windGust, forecastrecord::WINDGUST> },
+			{ "Gm", Typed<forecastrecord, uint8_t, &forecastrecord::windGust, forecastrecord::WINDGUST> },
+			{ "H", Typed<forecastrecord, uint8_t, &forecastrecord::humidity, forecastrecord::HUMIDITY> },
+			{ "Hn", Typed<forecastrecord, uint8_t, &forecastrecord::humidity, forecastrecord::HUMIDITY> },
+			{ "Hm", Typed<forecastrecord, uint8_t, &forecastrecord::humidity, forecastrecord::HUMIDITY> },
+			{ "T", Typed<forecastrecord, int8_t, &forecastrecord::temperature, forecastrecord::TEMPERATURE> },
+			{ "Dm", Typed<forecastrecord, int8_t, &forecastrecord::temperature, forecastrecord::TEMPERATURE> },
+			{ "Nm", Typed<forecastrecord, int8_t, &forecastrecord::temperature, forecastrecord::TEMPERATURE> },
+			{ "V", Typed<forecastrecord, visibilitycode, &forecastrecord::visibility, forecastrecord::VISIBILITY> },
+			{ "D", Typed<forecastrecord, compass, &forecastrecord::windDirection, forecastrecord::WINDDIRECTION> },
+			{ "S", Typed<forecastrecord, uint8_t, &forecastrecord::windSpeed, forecastrecord::WINDSPEED> },
+			{ "U", Typed<forecastrecord, uint8_t, &forecastrecord::uv, forecastrecord::UV> },
+			{ "W", Typed<forecastrecord, uint8_t, &forecastrecord::weatherType, forecastrecord::WEATHERTYPE> },
+			{ "Pp", Typed<forecastrecord, uint8_t, &forecastrecord::precipitationProb, forecastrecord::PRECIPITATION> },
+			{ "PPd", Typed<forecastrecord, uint8_t, &forecastrecord::precipitationProb, forecastrecord::PRECIPITATION> },
+			{ "PPn", Typed<forecastrecord, uint8_t, &forecastrecord::precipitationProb, forecastrecord::PRECIPITATION> },
+			{ "$", Minutes<forecastrecord> }
+		};
+		constexpr fieldtable<forecastrecord, sizeof(forecastrecord_codes) / sizeof(forecastrecord_codes[0])> forecastrecord_fields(forecastrecord_codes);
+		static_assert(forecastrecord_fields.unique, "Two forecast codes hash to the same slot, change FieldSlot");
+
+		constexpr fieldcode<observationrecord> observationrecord_codes[] = {
+			{ "G", Typed<observationrecord, uint8_t, &observationrecord::windGust, observationrecord::WINDGUST> },
+			{ "T", Typed<observationrecord, float, &observationrecord::temperature, observationrecord::TEMPERATURE> },
+			{ "V", Typed<observationrecord, uint32_t, &observationrecord::visibility, observationrecord::VISIBILITY> },
+			{ "D", Typed<observationrecord, compass, &observationrecord::windDirection, observationrecord::WINDDIRECTION> },
+			{ "S", Typed<observationrecord, uint8_t, &observationrecord::windSpeed, observationrecord::WINDSPEED> },
+			{ "W", Typed<observationrecord, uint8_t, &observationrecord::weatherType, observationrecord::WEATHERTYPE> },
+			{ "P", Typed<observationrecord, uint16_t, &observationrecord::pressure, observationrecord::PRESSURE> },
+			{ "Pt", Typed<observationrecord, tendencycode, &observationrecord::tendency, observationrecord::TENDENCY> },
+			{ "Dp", Typed<observationrecord, float, &observationrecord::dewPoint, observationrecord::DEWPOINT> },
+			{ "H", Typed<observationrecord, float, &observationrecord::humidity, observationrecord::HUMIDITY> },
+			{ "$", Minutes<observationrecord> }
+		};
+		constexpr fieldtable<observationrecord, sizeof(observationrecord_codes) / sizeof(observationrecord_codes[0])> observationrecord_fields(observationrecord_codes);
+		static_assert(observationrecord_fields.unique, "Two observation codes hash to the same slot, change FieldSlot");
+} //datapoint
+
+#endif /* DATAPOINT_FIELDS_H_ */
@@ -0,0 +1,107 @@
+/*
+ * DataPoint for C++
+ *
+ * Lazily decoded forecasts, see forecastview.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/forecastview.h"
+#include "../datapoint/datapoint.h"
+#include "../datapoint/fields.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+
+using namespace std;
+
+#define FORECASTVIEW_SPAN 10800 //Seconds a lone slot covers when there's no neighbour to go by
+
+datapoint::forecastrecord datapoint::forecastslot::Record() const {
+	forecastrecord record;
+	forecastrecord_fields.Decode(record, *rep);
+	return record;
+}
+
+datapoint::forecast datapoint::forecastslot::Forecast() const {
+	forecast frcst;
+	frcst.weatherType = 33 ; //As dumpForecast
+	forecast_fields.Decode(frcst, *rep);
+	tm day;
+	char date[16];
+	if (gmtime_r(&time, &day) && strftime(date, sizeof(date), "%Y-%m-%dZ", &day) > 0) { frcst.date = date; } //As Period's
+	return frcst;
+}
+
+datapoint::forecastview::forecastview(rapidjson::Document &&injson) : json(std::move(injson)) {
+	Index();
+}
+
+void datapoint::forecastview::Index() {
+	/*
+	 * Only "$" is read from each Rep. A Period or Rep on its own isn't wrapped in an array.
+	 */
+	if (!json.IsObject() || !json.HasMember("SiteRep") || !json["SiteRep"].HasMember("DV")
+			|| !json["SiteRep"]["DV"].HasMember("Location")) {
+		return;
+	}
+	const rapidjson::Value& location = json["SiteRep"]["DV"]["Location"];
+	if (location.HasMember("i")) { id = strtoul(location["i"].GetString(), NULL, 10); }
+	if (!location.HasMember("Period")) { return; }
+
+	const rapidjson::Value& days = location["Period"];
+	const rapidjson::Value *d_begin = &days, *d_end = &days + 1;
+	if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+	for (const rapidjson::Value *day = d_begin; day != d_end; ++day) {
+		time_t midnight;
+		const rapidjson::Value& value = (*day)["value"];
+		if (!ParseDate(value.GetString(), value.GetStringLength(), midnight) || !day->HasMember("Rep")) { continue; }
+
+		const rapidjson::Value& reps = (*day)["Rep"];
+		const rapidjson::Value *r_begin = &reps, *r_end = &reps + 1;
+		if (reps.IsArray()) { r_begin = reps.Begin(); r_end = reps.End(); }
+		for (const rapidjson::Value *rep = r_begin; rep != r_end; ++rep) {
+			rapidjson::Value::ConstMemberIterator mins = rep->FindMember("$");
+			if (mins == rep->MemberEnd() || !mins->value.IsString()) { continue; }
+			forecastrecord when; //Only minsofday is used, Minutes knows about Day and Night
+			if (!Minutes(when, mins->value.GetString(), mins->value.GetStringLength())) { continue; }
+			daily = daily || !isdigit((unsigned char)mins->value.GetString()[0]);
+			slots.push_back({ midnight + when.minsofday * 60, rep });
+		}
+	}
+	stable_sort(slots.begin(), slots.end(), [](const forecastslot &a, const forecastslot &b) { return a.time < b.time; });
+}
+
+const datapoint::forecastslot * datapoint::forecastview::At(time_t when) const {
+	/*
+	 * A slot runs until the next one starts. The last runs as long as the one before it did.
+	 */
+	if (slots.empty() || when < slots.front().time) { return nullptr; }
+	vector<forecastslot>::const_iterator after = upper_bound(slots.begin(), slots.end(), when,
+			[](time_t t, const forecastslot &s) { return t < s.time; });
+	const forecastslot *found = &*(after - 1);
+	if (after == slots.end()) {
+		time_t span = (slots.size() > 1) ? slots.back().time - slots[slots.size() - 2].time : FORECASTVIEW_SPAN;
+		if (when >= found->time + span) { return nullptr; }
+	}
+	return found;
+}
+
+datapoint::forecastrange datapoint::forecastview::Window(time_t from, time_t to) const {
+	forecastrange range;
+	range.first = range.last = end();
+	if (slots.empty() || to <= from) { return range; }
+	const forecastslot *covering = At(from);
+	const forecastslot *first = (covering) ? covering : lower_bound(begin(), end(), from,
+			[](const forecastslot &s, time_t t) { return s.time < t; });
+	const forecastslot *last = lower_bound(first, end(), to, [](const forecastslot &s, time_t t) { return s.time < t; });
+	if (first < last) {
+		range.first = first;
+		range.last = last;
+	}
+	return range;
+}
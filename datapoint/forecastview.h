@@ -0,0 +1,69 @@
+/*
+ * DataPoint for C++
+ *
+ * A forecast response kept parsed but not decoded. Building the view reads only each Rep's Period date and "$",
+ * giving every Rep an absolute UTC time. Nothing else is decoded until a slot is asked for its record, so asking
+ * for the next 6 hours costs two Reps rather than the whole five days. Works for 3hourly and daily responses
+ * alike, and holds however many Reps Datapoint sent.
+ *
+ */
+
+#ifndef DATAPOINT_FORECASTVIEW_H_
+#define DATAPOINT_FORECASTVIEW_H_
+
+#include <ctime>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "typed.h"
+
+namespace datapoint {
+		class forecast;
+		class forecastslot {
+			public:
+				time_t time; //UTC. Daily responses have their Day at midnight and Night at noon.
+				const rapidjson::Value *rep;
+				forecastrecord Record() const; //Decoded now, from the Rep
+				datapoint::forecast Forecast() const; //Same, into the string class
+		} ;//forecastslot
+		class forecastrange {
+			public:
+				const forecastslot *first = nullptr;
+				const forecastslot *last = nullptr;
+				const forecastslot * begin() const { return first; }
+				const forecastslot * end() const { return last; }
+				size_t size() const { return last - first; }
+				bool empty() const { return first == last; }
+				const forecastslot & operator[](size_t i) const { return first[i]; }
+		} ;//forecastrange
+		class forecastview {
+			/*
+			 * Owns the parsed response, so slots stay valid as long as the view does. Moving the view keeps them
+			 * valid too, as the values live in the document's allocator rather than the view.
+			 */
+			private:
+				rapidjson::Document json;
+				std::vector<forecastslot> slots; //Oldest first
+				unsigned int id = 0;
+				bool daily = false;
+				void Index();
+			public:
+				forecastview() {}
+				forecastview(rapidjson::Document &&injson);
+				forecastview(forecastview &&) = default;
+				forecastview & operator=(forecastview &&) = default;
+				size_t size() const { return slots.size(); }
+				bool empty() const { return slots.empty(); }
+				const forecastslot & operator[](size_t i) const { return slots[i]; }
+				const forecastslot * begin() const { return slots.data(); }
+				const forecastslot * end() const { return slots.data() + slots.size(); }
+				unsigned int Id() const { return id; } //Site, 0 if the response didn't say
+				bool Daily() const { return daily; }
+				const forecastslot * At(time_t when) const; //The slot covering 'when', nullptr outside the forecast
+				forecastrange Window(time_t from, time_t to) const; //Every slot overlapping [from, to)
+				forecastrange Next(time_t seconds) const { time_t now = time(nullptr); return Window(now, now + seconds); }
+		} ;//forecastview
+} //datapoint
+
+#endif /* DATAPOINT_FORECASTVIEW_H_ */
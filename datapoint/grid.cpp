@@ -0,0 +1,206 @@
+/*
+ * DataPoint for C++
+ *
+ * Batched site distances and gridded interpolation, see grid.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+#define EARTH_RADIUS 6371 //Kilometres
+
+static void UnitVector(double lat, double lon, float &x, float &y, float &z) {
+	double toRadians = M_PI / 180;
+	x = cos(lat * toRadians) * cos(lon * toRadians);
+	y = cos(lat * toRadians) * sin(lon * toRadians);
+	z = sin(lat * toRadians);
+}
+
+datapoint::sitegrid::sitegrid(const siteindex &sites) {
+	ids.resize(sites.Size());
+	x.resize(sites.Size());
+	y.resize(sites.Size());
+	z.resize(sites.Size());
+	for (size_t i = 0; i < sites.Size(); i++) {
+		ids[i] = sites[i].id;
+		UnitVector(sites[i].lat, sites[i].lon, x[i], y[i], z[i]);
+	}
+}
+
+void datapoint::sitegrid::Chords(float qx, float qy, float qz, const float *__restrict__ x, const float *__restrict__ y,
+		const float *__restrict__ z, size_t n, float *__restrict__ squared) {
+	/*
+	 * The kernel. Squared chord from the differences rather than 2 - 2 * dot, which loses everything to rounding
+	 * for sites a few km apart in float. No branches and no aliasing, so it vectorises at -O2 and up.
+	 */
+	for (size_t i = 0; i < n; i++) {
+		float dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+		squared[i] = dx * dx + dy * dy + dz * dz;
+	}
+}
+
+void datapoint::sitegrid::Distances(double lat, double lon, float *km) const {
+	float qx, qy, qz;
+	UnitVector(lat, lon, qx, qy, qz);
+	Chords(qx, qy, qz, x.data(), y.data(), z.data(), ids.size(), km);
+	for (size_t i = 0; i < ids.size(); i++) {
+		km[i] = 2 * EARTH_RADIUS * asin(min(1.0f, sqrt(km[i]) / 2)); //Chord to great circle
+	}
+}
+
+static double Chord(float ax, float ay, float az, float bx, float by, float bz) {
+	double dx = ax - bx, dy = ay - by, dz = az - bz;
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/*
+ * One square of the grid, span cells each side (less at the grid's edges). The sites given are every one that
+ * could matter anywhere in it. They're narrowed down for this square, then either used cell by cell or handed
+ * on to its four quarters.
+ */
+void datapoint::sitegrid::Region(const gridspec &grid, size_t row, size_t col, size_t span, const float *sx, const float *sy,
+		const float *sz, const float *sv, size_t n, unsigned int k, float power, float *out, size_t depth,
+		vector<vector<float> > &levels) const {
+	size_t rows = min(span, grid.rows - row), cols = min(span, grid.cols - col);
+
+	/*
+	 * If the centre's k-th nearest site is d away and no cell is further than r from the centre, every cell has
+	 * k sites within d + r. So no cell's k nearest can be further than d + 2r from the centre, and nothing
+	 * beyond that needs looking at. Chord distance is a true metric, so the triangle inequality holds.
+	 */
+	float cx, cy, cz;
+	UnitVector(grid.lat + (row + (rows - 1) / 2.0) * grid.latStep, grid.lon + (col + (cols - 1) / 2.0) * grid.lonStep, cx, cy, cz);
+	double reach = 0;
+	for (size_t r : { (size_t)0, (rows - 1) / 2, rows - 1 }) {
+		for (size_t c : { (size_t)0, (cols - 1) / 2, cols - 1 }) {
+			float px, py, pz;
+			UnitVector(grid.lat + (row + r) * grid.latStep, grid.lon + (col + c) * grid.lonStep, px, py, pz);
+			reach = max(reach, Chord(cx, cy, cz, px, py, pz));
+		}
+	}
+	reach *= 1.01; //Corners and edge midpoints, with a little slack for the curve in between
+
+	if (levels.size() <= depth) { levels.resize(depth + 1); }
+	levels[depth].resize(n * 6);
+	float *px = levels[depth].data(), *py = px + n, *pz = py + n, *pv = pz + n, *squared = pv + n, *ranked = squared + n;
+	Chords(cx, cy, cz, sx, sy, sz, n, squared);
+	copy(squared, squared + n, ranked);
+	size_t kth = min((size_t)k, n) - 1;
+	nth_element(ranked, ranked + kth, ranked + n);
+	double limit = sqrt(ranked[kth]) + 2 * reach;
+	limit *= limit;
+
+	/*
+	 * The survivors are packed into their own arrays so the kernel keeps running over contiguous memory.
+	 */
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (squared[i] <= limit) {
+			px[m] = sx[i]; py[m] = sy[i]; pz[m] = sz[i]; pv[m] = sv[i];
+			m++;
+		}
+	}
+
+	if (span > GRID_BLOCK) {
+		size_t half = span / 2;
+		for (size_t r = 0; r < rows; r += half) {
+			for (size_t c = 0; c < cols; c += half) {
+				Region(grid, row + r, col + c, half, px, py, pz, pv, m, k, power, out, depth + 1, levels);
+			}
+		}
+		return;
+	}
+
+	/*
+	 * Cells share their row's latitude and column's longitude, so the trig is done once per row and column.
+	 */
+	double toRadians = M_PI / 180;
+	float cosLat[GRID_BLOCK], sinLat[GRID_BLOCK], cosLon[GRID_BLOCK], sinLon[GRID_BLOCK];
+	for (size_t r = 0; r < rows; r++) {
+		cosLat[r] = cos((grid.lat + (row + r) * grid.latStep) * toRadians);
+		sinLat[r] = sin((grid.lat + (row + r) * grid.latStep) * toRadians);
+	}
+	for (size_t c = 0; c < cols; c++) {
+		cosLon[c] = cos((grid.lon + (col + c) * grid.lonStep) * toRadians);
+		sinLon[c] = sin((grid.lon + (col + c) * grid.lonStep) * toRadians);
+	}
+
+	float *pd = squared; //Free again now
+	for (size_t r = 0; r < rows; r++) {
+		for (size_t c = 0; c < cols; c++) {
+			float qx = cosLat[r] * cosLon[c], qy = cosLat[r] * sinLon[c], qz = sinLat[r];
+			Chords(qx, qy, qz, px, py, pz, m, pd);
+
+			float bestDistance[GRID_MAX_K], bestValue[GRID_MAX_K];
+			unsigned int found = 0;
+			for (size_t i = 0; i < m; i++) { //Insertion into the k best so far
+				if (found == k && pd[i] >= bestDistance[k - 1]) { continue; }
+				unsigned int at = (found < k) ? found++ : k - 1;
+				while (at > 0 && bestDistance[at - 1] > pd[i]) {
+					bestDistance[at] = bestDistance[at - 1];
+					bestValue[at] = bestValue[at - 1];
+					at--;
+				}
+				bestDistance[at] = pd[i];
+				bestValue[at] = pv[i];
+			}
+
+			float result;
+			if (found == 0) {
+				result = numeric_limits<float>::quiet_NaN();
+			} else if (bestDistance[0] == 0) {
+				result = bestValue[0]; //Right on a site
+			} else {
+				double weighted = 0, weights = 0;
+				for (unsigned int i = 0; i < found; i++) {
+					double weight = (power == 2) ? 1.0 / bestDistance[i] : pow((double)bestDistance[i], -power / 2);
+					weighted += weight * bestValue[i];
+					weights += weight;
+				}
+				result = weighted / weights;
+			}
+			out[(row + r) * grid.cols + col + c] = result;
+		}
+	}
+}
+
+void datapoint::sitegrid::Interpolate(const gridspec &grid, const float *values, float *out, unsigned int k, float power) const {
+	/*
+	 * values[] lines up with the sites (see Ids), NaN for a site with nothing to give. Cells with no site to go
+	 * on come out NaN. Distances are chords, which for neighbouring sites differ from great circle ones by
+	 * far less than the spread of the values.
+	 */
+	k = max(1u, min(k, (unsigned int)GRID_MAX_K));
+	vector<float> valid;
+	valid.reserve(ids.size() * 4);
+	for (const vector<float> *axis : { &x, &y, &z }) {
+		for (size_t i = 0; i < ids.size(); i++) {
+			if (isfinite(values[i])) { valid.push_back((*axis)[i]); }
+		}
+	}
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (isfinite(values[i])) { valid.push_back(values[i]); }
+	}
+	size_t n = valid.size() / 4;
+	if (n == 0) {
+		fill(out, out + grid.size(), numeric_limits<float>::quiet_NaN());
+		return;
+	}
+
+	vector<vector<float> > levels;
+	for (size_t row = 0; row < grid.rows; row += GRID_REGION) {
+		for (size_t col = 0; col < grid.cols; col += GRID_REGION) {
+			Region(grid, row, col, GRID_REGION, valid.data(), valid.data() + n, valid.data() + 2 * n, valid.data() + 3 * n,
+					n, k, power, out, 0, levels);
+		}
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * DataPoint for C++
+ *
+ * Site coordinates as structure of arrays, for work over many points at once. Each site is a unit vector split
+ * into x, y and z arrays of floats, so the distance kernel is a plain loop the compiler vectorises. Distances
+ * are compared as straight line (chord) distances through the Earth, which rank the same as great circle ones.
+ *
+ * Interpolate fills a regular lat/lon grid from per-site values, weighting each cell's k nearest sites by inverse
+ * distance. The grid is cut into squares, and each square into quarters down to small blocks. Every step narrows
+ * its parent's sites down to those that can be any of its cells' k nearest, so each cell only checks a short list.
+ *
+ */
+
+#ifndef DATAPOINT_GRID_H_
+#define DATAPOINT_GRID_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "siteindex.h"
+
+#define GRID_REGION 128 //Cells each side of the squares the grid is first cut into, halved down to GRID_BLOCK
+#define GRID_BLOCK 8 //Cells each side of a block sharing one list of candidate sites
+#define GRID_MAX_K 16 //Most neighbours one cell can be interpolated from
+
+namespace datapoint {
+		class gridspec {
+			/*
+			 * rows x cols cells, row major. Cell (row, col) is at lat + row * latStep, lon + col * lonStep, both in
+			 * degrees. Steps can be negative, e.g. to run north to south like an image.
+			 */
+			public:
+				double lat = 0;
+				double lon = 0;
+				double latStep = 0;
+				double lonStep = 0;
+				size_t rows = 0;
+				size_t cols = 0;
+				size_t size() const { return rows * cols; }
+		} ;//gridspec
+		class sitegrid {
+			private:
+				std::vector<unsigned int> ids;
+				std::vector<float> x; //Unit vectors, one array per axis
+				std::vector<float> y;
+				std::vector<float> z;
+				void Region(const gridspec &grid, size_t row, size_t col, size_t span, const float *sx, const float *sy, const float *sz,
+						const float *sv, size_t n, unsigned int k, float power, float *out, size_t depth,
+						std::vector<std::vector<float> > &levels) const;
+			public:
+				sitegrid() {}
+				sitegrid(const siteindex &sites); //In the index's order, so values line up with operator[] there too
+				size_t Size() const { return ids.size(); }
+				unsigned int Id(size_t i) const { return ids[i]; }
+				const std::vector<unsigned int> & Ids() const { return ids; }
+				void Distances(double lat, double lon, float *km) const; //To every site, km[Size()]
+				void Interpolate(const gridspec &grid, const float *values, float *out, unsigned int k = 4, float power = 2) const;
+				static void Chords(float qx, float qy, float qz, const float *x, const float *y, const float *z, size_t n, float *squared);
+		} ;//sitegrid
+} //datapoint
+
+#endif /* DATAPOINT_GRID_H_ */
@@ -0,0 +1,131 @@
+/*
+ * DataPoint for C++
+ *
+ * Observation history, see history.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/history.h"
+#include "../datapoint/fields.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+bool datapoint::observationhistory::Append(time_t when, const observationrecord &record) {
+	if (count && when <= Latest()) { return false; }
+	size_t slot = (head + count) % HISTORY_HOURS;
+	if (count == HISTORY_HOURS) {
+		head = (head + 1) % HISTORY_HOURS; //Full, the oldest hour makes way
+	} else {
+		count++;
+	}
+	records[slot] = record;
+	times[slot] = when;
+	return true;
+}
+
+const datapoint::observationrecord * datapoint::observationhistory::At(time_t when) const {
+	for (size_t i = count; i-- > 0;) { //Usually wanted near the newest end
+		if (Time(i) == when) { return &(*this)[i]; }
+		if (Time(i) < when) { break; }
+	}
+	return nullptr;
+}
+
+size_t datapoint::observationhistory::Update(const rapidjson::Document &json) {
+	return Update(json["SiteRep"]["DV"]["Location"]);
+}
+
+size_t datapoint::observationhistory::Update(const rapidjson::Value &location) {
+	/*
+	 * Periods and Reps arrive oldest first. Anything at or before the newest hour already held is skipped
+	 * without being decoded.
+	 */
+	if (location.HasMember("i")) {
+		unsigned int site = strtoul(location["i"].GetString(), NULL, 10);
+		if (site != id) {
+			clear();
+			id = site;
+		}
+	}
+	if (!location.HasMember("Period")) { return 0; }
+
+	size_t added = 0;
+	time_t latest = Latest();
+	const rapidjson::Value& days = location["Period"];
+	const rapidjson::Value *d_begin = &days, *d_end = &days + 1; //Period is an object rather than array just before midnight
+	if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+	for (const rapidjson::Value *day = d_begin; day != d_end; ++day) {
+		time_t midnight;
+		const rapidjson::Value& value = (*day)["value"];
+		if (!ParseDate(value.GetString(), value.GetStringLength(), midnight)) { continue; }
+		if (count && midnight + 86400 <= latest) { continue; } //The whole day is already held
+
+		const rapidjson::Value& hours = (*day)["Rep"];
+		const rapidjson::Value *h_begin = &hours, *h_end = &hours + 1; //And Rep just after
+		if (hours.IsArray()) { h_begin = hours.Begin(); h_end = hours.End(); }
+		for (const rapidjson::Value *hour = h_begin; hour != h_end; ++hour) {
+			uint16_t minsofday;
+			rapidjson::Value::ConstMemberIterator mins = hour->FindMember("$");
+			if (mins == hour->MemberEnd() || !mins->value.IsString()) { continue; }
+			if (!ParseNumber(mins->value.GetString(), mins->value.GetStringLength(), minsofday)) { continue; }
+			time_t when = midnight + minsofday * 60;
+			if (count && when <= latest) { continue; }
+
+			observationrecord record;
+			observationrecord_fields.Decode(record, *hour);
+			if (Append(when, record)) {
+				latest = when;
+				added++;
+			}
+		}
+	}
+	return added;
+}
+
+template <class T> bool datapoint::observationhistory::Change(T observationrecord::*member, observationrecord::field f,
+		unsigned int hours, float &out) const {
+	if (count == 0) { return false; }
+	const observationrecord &now = Back();
+	const observationrecord *then = At(Latest() - (time_t)hours * 3600);
+	if (!then || !now.Has(f) || !then->Has(f)) { return false; }
+	out = (float)(now.*member) - (float)(then->*member);
+	return true;
+}
+
+bool datapoint::observationhistory::PressureChange(unsigned int hours, float &hpa) const {
+	return Change(&observationrecord::pressure, observationrecord::PRESSURE, hours, hpa);
+}
+
+bool datapoint::observationhistory::TemperatureChange(unsigned int hours, float &celsius) const {
+	return Change(&observationrecord::temperature, observationrecord::TEMPERATURE, hours, celsius);
+}
+
+bool datapoint::observationhistory::DewPointChange(unsigned int hours, float &celsius) const {
+	return Change(&observationrecord::dewPoint, observationrecord::DEWPOINT, hours, celsius);
+}
+
+bool datapoint::observationhistory::HumidityChange(unsigned int hours, float &percent) const {
+	return Change(&observationrecord::humidity, observationrecord::HUMIDITY, hours, percent);
+}
+
+datapoint::observationhistory * datapoint::historystore::Find(unsigned int id) {
+	unordered_map<unsigned int, observationhistory>::iterator itr = sites.find(id);
+	return (itr == sites.end()) ? nullptr : &itr->second;
+}
+
+size_t datapoint::historystore::Update(const rapidjson::Document &json) {
+	const rapidjson::Value& locations = json["SiteRep"]["DV"]["Location"];
+	const rapidjson::Value *begin = &locations, *end = &locations + 1;
+	if (locations.IsArray()) { begin = locations.Begin(); end = locations.End(); }
+	size_t added = 0;
+	for (const rapidjson::Value *location = begin; location != end; ++location) {
+		unsigned int id = strtoul((*location)["i"].GetString(), NULL, 10);
+		added += sites[id].Update(*location);
+	}
+	return added;
+}
@@ -0,0 +1,66 @@
+/*
+ * DataPoint for C++
+ *
+ * Observation history. Datapoint sends the last 24 hours with every hourly observation request, and rather than
+ * keep only the latest hour, an observationhistory holds the whole window in a fixed ring of typed records.
+ * Each refresh appends only the hours newer than the last one held, overwriting the oldest, so the series is
+ * never rebuilt and trend questions (pressure over three hours, temperature since this morning) are answered
+ * from memory.
+ *
+ */
+
+#ifndef DATAPOINT_HISTORY_H_
+#define DATAPOINT_HISTORY_H_
+
+#include <ctime>
+#include <unordered_map>
+
+#include <rapidjson/document.h>
+
+#include "typed.h"
+
+#define HISTORY_HOURS 24 //What Datapoint sends in one hourly observation response
+
+namespace datapoint {
+		class observationhistory {
+			private:
+				observationrecord records[HISTORY_HOURS];
+				time_t times[HISTORY_HOURS];
+				size_t head = 0; //Oldest
+				size_t count = 0;
+				template <class T> bool Change(T observationrecord::*member, observationrecord::field f,
+						unsigned int hours, float &out) const;
+			public:
+				unsigned int id = 0; //Site, set by Update
+				size_t size() const { return count; }
+				bool empty() const { return count == 0; }
+				void clear() { head = 0; count = 0; id = 0; }
+				const observationrecord & operator[](size_t i) const { return records[(head + i) % HISTORY_HOURS]; } //0 is the oldest
+				time_t Time(size_t i) const { return times[(head + i) % HISTORY_HOURS]; } //UTC
+				const observationrecord & Back() const { return (*this)[count - 1]; }
+				time_t Latest() const { return (count) ? Time(count - 1) : 0; }
+				const observationrecord * At(time_t when) const; //The hour observed at 'when', if held
+				bool Append(time_t when, const observationrecord &record); //False unless newer than Latest()
+				size_t Update(const rapidjson::Document &json); //Appends the new hours of an hourly response, returns how many
+				size_t Update(const rapidjson::Value &location); //One SiteRep Location
+				/*
+				 * Trends, latest hour minus the hour 'hours' before it. False if either hour is missing or didn't
+				 * include the field.
+				 */
+				bool PressureChange(unsigned int hours, float &hpa) const;
+				bool TemperatureChange(unsigned int hours, float &celsius) const;
+				bool DewPointChange(unsigned int hours, float &celsius) const;
+				bool HumidityChange(unsigned int hours, float &percent) const;
+		} ;//observationhistory
+		class historystore {
+			/*
+			 * One observationhistory per site, for keeping up with an "all sites" response.
+			 */
+			public:
+				std::unordered_map<unsigned int, observationhistory> sites;
+				observationhistory * Find(unsigned int id);
+				size_t Update(const rapidjson::Document &json); //Every Location in the response, returns hours added
+		} ;//historystore
+} //datapoint
+
+#endif /* DATAPOINT_HISTORY_H_ */
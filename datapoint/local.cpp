@@ -0,0 +1,439 @@
+/*
+ * DataPoint for C++
+ *
+ * Shared query daemon and its client, see local.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/local.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define LOCAL_HOURS 28 //Size of the array GetForecast() returns, as api's
+#define LOCAL_PUBLISHES 3 //Snapshots a miss waits through. By the third, one refresh began after it was subscribed.
+#define LOCAL_WAKE_MS 250 //How often a waiting miss checks for Stop
+#define LOCAL_ACCEPT_BACKOFF_MS 100 //Pause after accept fails for want of descriptors or memory
+
+static_assert(sizeof(datapoint::localrequest) == 24, "localrequest is sent as is");
+static_assert(sizeof(datapoint::localreply) == 20, "localreply is sent as is");
+
+static bool ReadAll(int fd, void *into, size_t size) {
+	char *at = (char*)into;
+	while (size > 0) {
+		ssize_t got = recv(fd, at, size, 0);
+		if (got <= 0) { return false; }
+		at += got;
+		size -= got;
+	}
+	return true;
+}
+
+static bool WriteAll(int fd, const void *from, size_t size) {
+	const char *at = (const char*)from;
+	while (size > 0) {
+		ssize_t sent = send(fd, at, size, MSG_NOSIGNAL);
+		if (sent <= 0) { return false; }
+		at += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static bool Address(const string &path, sockaddr_un &address) {
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(address.sun_path)) { return false; }
+	memcpy(address.sun_path, path.c_str(), path.size());
+	return true;
+}
+
+/*
+ * The payload. Datapoint's values are a few characters, so a byte of length is plenty.
+ */
+static void Put(string &out, const string &str) {
+	size_t length = min(str.size(), (size_t)255);
+	out.push_back((char)length);
+	out.append(str, 0, length);
+}
+
+static void Put(string &out, unsigned short int value) {
+	uint16_t wide = value;
+	out.append((const char*)&wide, sizeof(wide));
+}
+
+static void Put(string &out, const datapoint::forecast &frcst) {
+	Put(out, frcst.feelsLike); Put(out, frcst.windGust); Put(out, frcst.humidity); Put(out, frcst.temperature);
+	Put(out, frcst.visibility); Put(out, frcst.windDirection); Put(out, frcst.windSpeed); Put(out, frcst.uv);
+	Put(out, frcst.weatherType); Put(out, frcst.precipitationProb); Put(out, frcst.minsofday); Put(out, frcst.date);
+}
+
+static void Put(string &out, const datapoint::observation &obs) {
+	Put(out, obs.windGust); Put(out, obs.temperature); Put(out, obs.visibility); Put(out, obs.windDirection);
+	Put(out, obs.windSpeed); Put(out, obs.weatherType); Put(out, obs.pressure); Put(out, obs.tendency);
+	Put(out, obs.dewPoint); Put(out, obs.humidity);
+}
+
+class payloadreader {
+	private:
+		const char *at;
+		const char *end;
+	public:
+		bool ok = true; //False once anything has run past the end
+		payloadreader(const string &payload) : at(payload.data()), end(payload.data() + payload.size()) {}
+		void Get(string &str) {
+			size_t length = (ok && at < end) ? (unsigned char)*at : 0;
+			if (!ok || at + 1 + length > end) { ok = false; return; }
+			str.assign(at + 1, length);
+			at += 1 + length;
+		}
+		void Get(unsigned short int &value) {
+			uint16_t wide;
+			if (!ok || at + sizeof(wide) > end) { ok = false; return; }
+			memcpy(&wide, at, sizeof(wide));
+			value = wide;
+			at += sizeof(wide);
+		}
+		void Get(datapoint::forecast &frcst) {
+			Get(frcst.feelsLike); Get(frcst.windGust); Get(frcst.humidity); Get(frcst.temperature);
+			Get(frcst.visibility); Get(frcst.windDirection); Get(frcst.windSpeed); Get(frcst.uv);
+			Get(frcst.weatherType); Get(frcst.precipitationProb); Get(frcst.minsofday); Get(frcst.date);
+		}
+		void Get(datapoint::observation &obs) {
+			Get(obs.windGust); Get(obs.temperature); Get(obs.visibility); Get(obs.windDirection);
+			Get(obs.windSpeed); Get(obs.weatherType); Get(obs.pressure); Get(obs.tendency);
+			Get(obs.dewPoint); Get(obs.humidity);
+		}
+} ;//payloadreader
+
+datapoint::localserver::localserver(string key) : refresh(key) {}
+
+datapoint::localserver::~localserver() {
+	Stop();
+}
+
+bool datapoint::localserver::Listen(string inpath) {
+	/*
+	 * The sitelists are got once, up front. Every lookup after that is resolved here without touching the network.
+	 */
+	try {
+		forecast_sites = refresh.Source().Getsites(true);
+		observation_sites = refresh.Source().Getsites(false);
+	} catch (...) {
+		return false;
+	}
+
+	sockaddr_un address;
+	if (!Address(inpath, address)) { return false; }
+	struct stat existing;
+	if (stat(inpath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+		/*
+		 * Only a socket nobody is listening on was left behind by a daemon that didn't stop cleanly. One that
+		 * answers belongs to a running daemon, and anything else is left for whoever owns it.
+		 */
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (probe < 0) { return false; }
+		bool stale = connect(probe, (sockaddr*)&address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+		close(probe);
+		if (!stale) { return false; }
+		unlink(inpath.c_str());
+	}
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+		if (listener >= 0) { close(listener); }
+		listener = -1;
+		return false;
+	}
+	path = inpath;
+
+	refresh.Start();
+	batcher = thread(&localserver::Batch, this);
+	acceptor = thread(&localserver::Accept, this);
+	return true;
+}
+
+void datapoint::localserver::Stop() {
+	{
+		lock_guard<mutex> guard(lock);
+		if (stopping) { return; }
+		stopping = true;
+	}
+	queued.notify_all();
+	if (listener >= 0) { shutdown(listener, SHUT_RDWR); } //Wakes accept
+	if (acceptor.joinable()) { acceptor.join(); }
+	if (batcher.joinable()) { batcher.join(); }
+
+	/*
+	 * Shutting the connections down wakes their threads out of recv. A thread waiting on a new site notices
+	 * within LOCAL_WAKE_MS.
+	 */
+	unique_lock<mutex> guard(lock);
+	for (int fd : connections) { shutdown(fd, SHUT_RDWR); }
+	finished.wait(guard, [this]() { return connections.empty(); });
+	guard.unlock();
+
+	if (listener >= 0) {
+		close(listener);
+		listener = -1;
+		unlink(path.c_str());
+	}
+}
+
+void datapoint::localserver::Accept() {
+	while (true) {
+		int fd = accept(listener, NULL, NULL);
+		int error = errno;
+		{
+			lock_guard<mutex> guard(lock);
+			if (stopping) {
+				if (fd >= 0) { close(fd); }
+				return;
+			}
+			if (fd >= 0) {
+				connections.push_back(fd);
+				thread(&localserver::Serve, this, fd).detach(); //Stop waits for it through 'connections'
+				continue;
+			}
+		}
+		if (error == EINTR || error == ECONNABORTED) { continue; } //That one client gave up, try the next
+		if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+			this_thread::sleep_for(chrono::milliseconds(LOCAL_ACCEPT_BACKOFF_MS)); //Until connections close
+			continue;
+		}
+		return; //The listener itself is broken, retrying would only spin
+	}
+}
+
+void datapoint::localserver::Serve(int fd) {
+	localrequest request;
+	string payload;
+	while (ReadAll(fd, &request, sizeof(request))) {
+		localreply reply = Answer(request, payload);
+		if (!WriteAll(fd, &reply, sizeof(reply)) || !WriteAll(fd, payload.data(), payload.size())) { break; }
+		if (reply.status == localreply::BADREQUEST) { break; } //Out of step, or not a client at all
+	}
+	{
+		lock_guard<mutex> guard(lock);
+		connections.erase(find(connections.begin(), connections.end(), fd));
+		close(fd); //Under the lock, so Stop never shuts down a number that's been reused
+	}
+	finished.notify_all();
+}
+
+void datapoint::localserver::Queue(localrequest::query kind, unsigned int id) {
+	{
+		lock_guard<mutex> guard(lock);
+		vector<unsigned int> &already = subscribed[kind];
+		vector<unsigned int>::iterator itr = lower_bound(already.begin(), already.end(), id);
+		if (itr != already.end() && *itr == id) { return; } //Someone else is already waiting on it
+		already.insert(itr, id);
+		((kind == localrequest::FORECASTQUERY) ? forecast_queue : observation_queue).push_back(id);
+	}
+	queued.notify_all();
+}
+
+void datapoint::localserver::Batch() {
+	unique_lock<mutex> guard(lock);
+	while (!stopping) {
+		queued.wait(guard, [this]() { return stopping || !forecast_queue.empty() || !observation_queue.empty(); });
+		if (stopping) { break; }
+		guard.unlock();
+		this_thread::sleep_for(chrono::milliseconds(LOCAL_BATCH_MS)); //Lets the rest of a burst arrive
+		guard.lock();
+		vector<unsigned int> forecasts, observations;
+		forecasts.swap(forecast_queue);
+		observations.swap(observation_queue);
+		guard.unlock();
+		refresh.Subscribe(forecasts, observations);
+		guard.lock();
+	}
+}
+
+datapoint::localreply datapoint::localserver::Answer(const localrequest &request, string &payload) {
+	localreply reply;
+	payload.clear();
+	if (request.magic != LOCAL_MAGIC || request.kind > localrequest::OBSERVATIONQUERY
+			|| !isfinite(request.lat) || !isfinite(request.lon)) {
+		reply.status = localreply::BADREQUEST;
+		return reply;
+	}
+	bool isForecast = request.kind == localrequest::FORECASTQUERY;
+	const siteindex *sites = (isForecast) ? forecast_sites.get() : observation_sites.get();
+	const site *nearest = (sites) ? sites->Nearest(request.lat, request.lon) : nullptr;
+	if (!nearest) {
+		reply.status = localreply::NOSITES;
+		return reply;
+	}
+	reply.site = nearest->id;
+
+	/*
+	 * A site already refreshing is copied out of the current snapshot, held until the copy's done. A new one is
+	 * queued, and the snapshots published after are held in turn while they're checked for it. One whose last
+	 * fetch failed is answered straight away rather than kept waiting for a retry minutes off.
+	 */
+	shared_ptr<const snapshot> held = refresh.Read();
+	const snapshot *current = held.get();
+	bool found = (isForecast) ? current->Forecast(reply.site) != nullptr : current->Observation(reply.site) != nullptr;
+	if (!found && refresh.Failing(reply.site, isForecast)) {
+		reply.status = localreply::UNAVAILABLE;
+		return reply;
+	}
+	if (!found) {
+		Queue(request.kind, reply.site);
+		unsigned long version = current->version;
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(LOCAL_WAIT_MS);
+		for (int publishes = 0; !found && publishes < LOCAL_PUBLISHES && !stopping; ) {
+			chrono::steady_clock::time_point now = chrono::steady_clock::now();
+			if (now >= deadline) { break; }
+			held = refresh.Wait(version, min(deadline, now + chrono::milliseconds(LOCAL_WAKE_MS)));
+			if (held->version != version) {
+				version = held->version;
+				publishes++;
+				current = held.get();
+				found = (isForecast) ? current->Forecast(reply.site) != nullptr : current->Observation(reply.site) != nullptr;
+			}
+			if (!found && refresh.Failing(reply.site, isForecast)) { break; } //Tried since it was queued, and failed
+		}
+		if (!found) {
+			reply.status = localreply::UNAVAILABLE;
+			return reply;
+		}
+	}
+
+	Put(payload, nearest->name);
+	Put(payload, nearest->area);
+	if (isForecast) {
+		const vector<forecast> *forecasts = current->Forecast(reply.site);
+		reply.count = forecasts->size();
+		for (const forecast &frcst : *forecasts) { Put(payload, frcst); }
+	} else {
+		reply.count = 1;
+		Put(payload, *current->Observation(reply.site));
+	}
+	reply.bytes = payload.size();
+	return reply;
+}
+
+datapoint::localclient::~localclient() {
+	Close();
+}
+
+bool datapoint::localclient::Connect() {
+	if (fd >= 0) { return true; }
+	sockaddr_un address;
+	if (!Address(path, address)) { return false; }
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) == 0) { return true; }
+	Close();
+	return false;
+}
+
+void datapoint::localclient::Close() {
+	if (fd >= 0) { close(fd); }
+	fd = -1;
+}
+
+datapoint::localreply datapoint::localclient::Ask(localrequest::query kind, string &payload) {
+	localrequest request;
+	request.kind = kind;
+	request.lat = lat;
+	request.lon = lon;
+	localreply reply;
+	for (int attempt = 0; attempt < 2; attempt++) { //The daemon may have restarted since the last call
+		if (!Connect()) { break; }
+		if (WriteAll(fd, &request, sizeof(request)) && ReadAll(fd, &reply, sizeof(reply))
+				&& reply.magic == LOCAL_MAGIC && reply.bytes <= LOCAL_REPLY_MAX) {
+			payload.resize(reply.bytes);
+			if (ReadAll(fd, &payload[0], reply.bytes)) { break; }
+		}
+		Close();
+	}
+	if (fd < 0) {
+		cout << "Couldn't get an answer from the DataPoint daemon at " << path << endl ;
+		throw 1;
+	}
+	switch (reply.status) {
+		case localreply::OK:
+			return reply;
+		case localreply::NOSITES:
+			cout << "The DataPoint daemon has no usable sitelist." << endl ;
+			break;
+		case localreply::UNAVAILABLE:
+			cout << "The DataPoint daemon couldn't get data for site " << reply.site << "." << endl ;
+			break;
+		default:
+			cout << "The DataPoint daemon didn't understand the request." << endl ;
+			break;
+	}
+	throw 1;
+}
+
+bool datapoint::localclient::Setlocation(double our_lat, double our_lon) {
+	lat = our_lat;
+	lon = our_lon;
+	forecast_id = 0;
+	observation_id = 0;
+	return true;
+}
+
+std::vector<datapoint::forecast> datapoint::localclient::GetForecasts() {
+	string payload;
+	localreply reply = Ask(localrequest::FORECASTQUERY, payload);
+	payloadreader in(payload);
+	in.Get(forecast_name);
+	in.Get(forecast_area);
+	vector<forecast> forecasts(min<size_t>(reply.count, payload.size())); //Each takes at least a byte
+	for (forecast &frcst : forecasts) { in.Get(frcst); }
+	if (!in.ok) {
+		cout << "The DataPoint daemon sent a reply that doesn't decode." << endl ;
+		throw 1;
+	}
+	forecast_id = reply.site;
+	return forecasts;
+}
+
+size_t datapoint::localclient::GetForecast(datapoint::forecast *buffer, size_t size) {
+	vector<forecast> forecasts = GetForecasts();
+	size_t filled = min(size, forecasts.size());
+	for (size_t i = 0; i < filled; i++) { buffer[i] = std::move(forecasts[i]); }
+	return filled;
+}
+
+datapoint::forecast * datapoint::localclient::GetForecast() {
+	static thread_local forecast frcst[LOCAL_HOURS];
+	size_t filled = GetForecast(frcst, LOCAL_HOURS);
+	for (size_t i = filled; i < LOCAL_HOURS; i++) { //As api's, nothing left over from an earlier call
+		frcst[i] = forecast();
+		frcst[i].weatherType = 33;
+	}
+	return frcst;
+}
+
+datapoint::observation datapoint::localclient::GetObservation() {
+	string payload;
+	localreply reply = Ask(localrequest::OBSERVATIONQUERY, payload);
+	payloadreader in(payload);
+	observation obs;
+	in.Get(observation_name);
+	in.Get(observation_area);
+	in.Get(obs);
+	if (!in.ok || reply.count != 1) {
+		cout << "The DataPoint daemon sent a reply that doesn't decode." << endl ;
+		throw 1;
+	}
+	observation_id = reply.site;
+	return obs;
+}
@@ -0,0 +1,129 @@
+/*
+ * DataPoint for C++
+ *
+ * A shared query daemon for one host. The localserver owns the Datapoint key, the sitelist indexes and a
+ * refresher, and answers lookups from local processes over a Unix domain socket. A localclient has the same
+ * Setlocation/GetForecast/GetObservation calls as api but asks the daemon, so it needs no key, no sitelist and
+ * no network. However many clients there are, the host makes one set of Datapoint requests.
+ *
+ * Sites that are already refreshing are answered straight from the current snapshot. A site nobody has asked
+ * for yet is queued. The queue is handed to the refresher every LOCAL_BATCH_MS as one subscription, so a burst
+ * of new sites is fetched together, and only those sites, and a site asked for by many clients at once is
+ * subscribed once. From then on the refresher keeps it up to date on Datapoint's schedule. A site whose last
+ * fetch failed is reported unavailable at once until a retry gets it.
+ *
+ * The protocol is a fixed size request and reply header, with the reply's strings length prefixed after it.
+ * Both ends are built from this header on the same host, so numbers go in native byte order.
+ *
+ */
+
+#ifndef DATAPOINT_LOCAL_H_
+#define DATAPOINT_LOCAL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "refresher.h"
+
+#define LOCAL_SOCKET "/tmp/datapoint.sock" //Default path for the daemon's socket
+#define LOCAL_MAGIC 0x32504444 //"DDP2" in memory on little endian, checked on both ends. New with each payload change.
+#define LOCAL_BATCH_MS 5 //How long new sites gather before they're subscribed together
+#define LOCAL_WAIT_MS 30000 //Longest a client waits for a new site's first refresh
+#define LOCAL_REPLY_MAX (1 << 20) //Bytes, far more than five days of forecasts
+
+namespace datapoint {
+		class localrequest {
+			public:
+				enum query : uint8_t { FORECASTQUERY, OBSERVATIONQUERY };
+				uint32_t magic = LOCAL_MAGIC;
+				query kind = FORECASTQUERY;
+				uint8_t reserved[3] = {};
+				double lat = 0;
+				double lon = 0;
+		} ;//localrequest
+		class localreply {
+			/*
+			 * Followed by 'bytes' of payload: the site's name and area, then 'count' forecasts or observations.
+			 * Each string is a one byte length then its characters, in the order the class declares them, with
+			 * weatherType as two bytes where it falls.
+			 */
+			public:
+				enum result : uint8_t { OK, BADREQUEST, NOSITES, UNAVAILABLE };
+				uint32_t magic = LOCAL_MAGIC;
+				result status = OK;
+				uint8_t reserved[3] = {};
+				uint32_t site = 0;
+				uint32_t count = 0;
+				uint32_t bytes = 0;
+		} ;//localreply
+		class localserver {
+			private:
+				refresher refresh;
+				std::shared_ptr<const siteindex> forecast_sites;
+				std::shared_ptr<const siteindex> observation_sites;
+				std::string path;
+				int listener = -1;
+				std::thread acceptor;
+				std::thread batcher;
+				std::mutex lock; //The queue, subscribed sites and open connections
+				std::condition_variable queued;
+				std::condition_variable finished; //A connection closed
+				std::vector<unsigned int> forecast_queue; //Waiting to be subscribed
+				std::vector<unsigned int> observation_queue;
+				std::vector<unsigned int> subscribed[2]; //Sorted, by query kind. Never queued twice.
+				std::vector<int> connections; //Each has a thread serving it
+				std::atomic<bool> stopping{false};
+				void Accept();
+				void Batch();
+				void Serve(int fd);
+				void Queue(localrequest::query kind, unsigned int id);
+				localreply Answer(const localrequest &request, std::string &payload);
+			public:
+				localserver(std::string key);
+				~localserver(); //Stops, and removes the socket
+				localserver(const localserver &) = delete;
+				localserver & operator=(const localserver &) = delete;
+				api & Source() { return refresh.Source(); } //Set a URL, cache, scheduler etc. before Listen
+				refresher & Refresher() { return refresh; } //To subscribe sites up front
+				bool Listen(std::string inpath = LOCAL_SOCKET); //Gets both sitelists, then serves in the background. false if a daemon already answers
+				void Stop();
+		} ;//localserver
+		class localclient {
+			/*
+			 * One connection, opened on first use and reopened once if the daemon has gone away. Like api, use one
+			 * per thread. Errors are reported the way api reports them.
+			 */
+			private:
+				std::string path;
+				int fd = -1;
+				double lat = 0;
+				double lon = 0;
+				bool Connect();
+				void Close();
+				localreply Ask(localrequest::query kind, std::string &payload);
+			public:
+				unsigned int forecast_id = 0; //As api, filled in by the first call
+				std::string forecast_name;
+				std::string forecast_area;
+				unsigned int observation_id = 0;
+				std::string observation_name;
+				std::string observation_area;
+				localclient(std::string inpath = LOCAL_SOCKET) : path(inpath) {}
+				~localclient();
+				localclient(const localclient &) = delete;
+				localclient & operator=(const localclient &) = delete;
+				bool Setlocation(double our_lat, double our_lon) ;
+				datapoint::forecast * GetForecast() ; //Overwritten by the next call on the same thread, as api
+				std::vector<datapoint::forecast> GetForecasts() ;
+				size_t GetForecast(datapoint::forecast *buffer, size_t size) ;
+				datapoint::observation GetObservation() ;
+		} ;//localclient
+} //datapoint
+
+#endif /* DATAPOINT_LOCAL_H_ */
@@ -0,0 +1,389 @@
+/*
+ * DataPoint for C++
+ *
+ * Binary snapshot files, see mapped.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/mapped.h"
+#include "../datapoint/fields.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define SNAPSHOT_FORECAST_SPAN 10800 //Seconds the last forecast of a run covers when there's no gap to go by
+
+static uint64_t Align(uint64_t offset) {
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+datapoint::forecastrecord datapoint::snapforecast::Record() const {
+	forecastrecord record;
+	record.minsofday = (uint16_t)(((time % 86400) + 86400) % 86400 / 60);
+	record.feelsLike = feelsLike;
+	record.temperature = temperature;
+	record.windGust = windGust;
+	record.windSpeed = windSpeed;
+	record.humidity = humidity;
+	record.precipitationProb = precipitationProb;
+	record.uv = uv;
+	record.weatherType = weatherType;
+	record.visibility = visibility;
+	record.windDirection = windDirection;
+	record.missing = missing;
+	return record;
+}
+
+datapoint::observationrecord datapoint::snapobservation::Record() const {
+	observationrecord record;
+	record.minsofday = (uint16_t)(((time % 86400) + 86400) % 86400 / 60);
+	record.temperature = temperature;
+	record.dewPoint = dewPoint;
+	record.humidity = humidity;
+	record.visibility = visibility;
+	record.pressure = pressure;
+	record.windGust = windGust;
+	record.windSpeed = windSpeed;
+	record.weatherType = weatherType;
+	record.windDirection = windDirection;
+	record.tendency = tendency;
+	record.missing = missing;
+	return record;
+}
+
+static datapoint::snapforecast Pack(time_t when, const datapoint::forecastrecord &record) {
+	datapoint::snapforecast packed = {};
+	packed.time = when;
+	packed.missing = record.missing;
+	packed.feelsLike = record.feelsLike;
+	packed.temperature = record.temperature;
+	packed.windGust = record.windGust;
+	packed.windSpeed = record.windSpeed;
+	packed.humidity = record.humidity;
+	packed.precipitationProb = record.precipitationProb;
+	packed.uv = record.uv;
+	packed.weatherType = record.weatherType;
+	packed.visibility = record.visibility;
+	packed.windDirection = record.windDirection;
+	return packed;
+}
+
+static datapoint::snapobservation Pack(time_t when, const datapoint::observationrecord &record) {
+	datapoint::snapobservation packed = {};
+	packed.time = when;
+	packed.temperature = record.temperature;
+	packed.dewPoint = record.dewPoint;
+	packed.humidity = record.humidity;
+	packed.visibility = record.visibility;
+	packed.pressure = record.pressure;
+	packed.missing = record.missing;
+	packed.windGust = record.windGust;
+	packed.windSpeed = record.windSpeed;
+	packed.weatherType = record.weatherType;
+	packed.windDirection = record.windDirection;
+	packed.tendency = record.tendency;
+	return packed;
+}
+
+/*
+ * Every Rep of every Location in a response, timestamped from its Period's date and its "$". A site sent twice, or
+ * a later response for the same site, replaces the hours it repeats and keeps the rest.
+ */
+template <class Record, class Packed, size_t N>
+static size_t AddReps(const rapidjson::Document &json, const datapoint::fieldtable<Record, N> &table,
+		map<unsigned int, vector<Packed> > &store) {
+	if (!json.IsObject() || !json.HasMember("SiteRep") || !json["SiteRep"].HasMember("DV")
+			|| !json["SiteRep"]["DV"].HasMember("Location")) {
+		return 0;
+	}
+	const rapidjson::Value& locations = json["SiteRep"]["DV"]["Location"];
+	const rapidjson::Value *l_begin = &locations, *l_end = &locations + 1; //One site isn't wrapped in an array
+	if (locations.IsArray()) { l_begin = locations.Begin(); l_end = locations.End(); }
+
+	size_t added = 0;
+	for (const rapidjson::Value *location = l_begin; location != l_end; ++location) {
+		if (!location->HasMember("i") || !location->HasMember("Period")) { continue; }
+		vector<Packed> &run = store[strtoul((*location)["i"].GetString(), NULL, 10)];
+		size_t before = run.size();
+
+		const rapidjson::Value& days = (*location)["Period"];
+		const rapidjson::Value *d_begin = &days, *d_end = &days + 1;
+		if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+		for (const rapidjson::Value *day = d_begin; day != d_end; ++day) {
+			time_t midnight;
+			const rapidjson::Value& value = (*day)["value"];
+			if (!datapoint::ParseDate(value.GetString(), value.GetStringLength(), midnight) || !day->HasMember("Rep")) { continue; }
+
+			const rapidjson::Value& reps = (*day)["Rep"];
+			const rapidjson::Value *r_begin = &reps, *r_end = &reps + 1;
+			if (reps.IsArray()) { r_begin = reps.Begin(); r_end = reps.End(); }
+			for (const rapidjson::Value *rep = r_begin; rep != r_end; ++rep) {
+				Record record;
+				table.Decode(record, *rep);
+				run.push_back(Pack(midnight + record.minsofday * 60, record));
+			}
+		}
+
+		/*
+		 * Newest wins on a repeated hour, so sort stably and keep the last of each run of equal times.
+		 */
+		stable_sort(run.begin(), run.end(), [](const Packed &a, const Packed &b) { return a.time < b.time; });
+		size_t kept = 0;
+		for (size_t i = 0; i < run.size(); i++) {
+			if (kept > 0 && run[kept - 1].time == run[i].time) { run[kept - 1] = run[i]; continue; }
+			run[kept++] = run[i];
+		}
+		run.resize(kept);
+		added += (run.size() > before) ? run.size() - before : 0;
+	}
+	return added;
+}
+
+void datapoint::snapshotwriter::Sites(const siteindex &index) {
+	for (size_t i = 0; i < index.Size(); i++) {
+		sites.emplace(index[i].id, index[i]);
+	}
+}
+
+size_t datapoint::snapshotwriter::Forecasts(const rapidjson::Document &json) {
+	return AddReps(json, forecastrecord_fields, forecasts);
+}
+
+size_t datapoint::snapshotwriter::Observations(const rapidjson::Document &json) {
+	return AddReps(json, observationrecord_fields, observations);
+}
+
+template <class Packed>
+static bool WriteRuns(ofstream &out, const map<unsigned int, vector<Packed> > &runs, uint64_t indexOffset, uint64_t recordOffset) {
+	uint32_t first = 0;
+	out.seekp(indexOffset);
+	for (const pair<const unsigned int, vector<Packed> > &run : runs) {
+		if (run.second.empty()) { continue; }
+		datapoint::snapentry entry = {};
+		entry.id = run.first;
+		entry.first = first;
+		entry.count = run.second.size();
+		out.write((const char*)&entry, sizeof(entry));
+		first += entry.count;
+	}
+	out.seekp(recordOffset);
+	for (const pair<const unsigned int, vector<Packed> > &run : runs) {
+		out.write((const char*)run.second.data(), run.second.size() * sizeof(Packed));
+	}
+	return (bool)out;
+}
+
+template <class Packed>
+static void Count(const map<unsigned int, vector<Packed> > &runs, uint32_t &sites, uint32_t &records) {
+	sites = 0;
+	records = 0;
+	for (const pair<const unsigned int, vector<Packed> > &run : runs) {
+		if (run.second.empty()) { continue; }
+		sites++;
+		records += run.second.size();
+	}
+}
+
+bool datapoint::snapshotwriter::Write(string path) const {
+	snapheader head = {};
+	memcpy(head.magic, SNAPSHOT_MAGIC, 4);
+	head.version = SNAPSHOT_VERSION;
+	head.byteorder = SNAPSHOT_BYTEORDER;
+	head.created = time(nullptr);
+	head.sites = sites.size();
+	Count(forecasts, head.forecastSites, head.forecasts);
+	Count(observations, head.observationSites, head.observations);
+
+	/*
+	 * Site strings go in one blob at the end, each name and area referenced by offset and length.
+	 */
+	string blob;
+	vector<snapsite> table;
+	table.reserve(sites.size());
+	for (const pair<const unsigned int, site> &s : sites) {
+		snapsite entry = {};
+		entry.id = s.first;
+		entry.lat = s.second.lat;
+		entry.lon = s.second.lon;
+		entry.nameLength = min(s.second.name.size(), (size_t)UINT16_MAX);
+		entry.name = blob.size();
+		blob.append(s.second.name, 0, entry.nameLength);
+		entry.areaLength = min(s.second.area.size(), (size_t)UINT16_MAX);
+		entry.area = blob.size();
+		blob.append(s.second.area, 0, entry.areaLength);
+		table.push_back(entry);
+	}
+
+	head.siteOffset = Align(sizeof(snapheader));
+	head.forecastIndexOffset = Align(head.siteOffset + head.sites * sizeof(snapsite));
+	head.forecastOffset = Align(head.forecastIndexOffset + head.forecastSites * sizeof(snapentry));
+	head.observationIndexOffset = Align(head.forecastOffset + (uint64_t)head.forecasts * sizeof(snapforecast));
+	head.observationOffset = Align(head.observationIndexOffset + head.observationSites * sizeof(snapentry));
+	head.stringOffset = Align(head.observationOffset + (uint64_t)head.observations * sizeof(snapobservation));
+	head.stringLength = blob.size();
+
+	/*
+	 * Written beside the real file and renamed over it. Readers that already have the old file mapped keep it,
+	 * new ones get the whole new file.
+	 */
+	string temporary = path + ".tmp";
+	{
+		ofstream out(temporary, ios_base::out | ios_base::binary | ios_base::trunc);
+		if (!out) { return false; }
+		out.write((const char*)&head, sizeof(head));
+		out.seekp(head.siteOffset);
+		out.write((const char*)table.data(), table.size() * sizeof(snapsite));
+		bool ok = WriteRuns(out, forecasts, head.forecastIndexOffset, head.forecastOffset)
+				&& WriteRuns(out, observations, head.observationIndexOffset, head.observationOffset);
+		out.seekp(head.stringOffset);
+		out.write(blob.data(), blob.size());
+		if (!ok || !out) {
+			out.close();
+			remove(temporary.c_str());
+			return false;
+		}
+	}
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool datapoint::mappedsnapshot::Open(string path) {
+	Close();
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(snapheader)) {
+		close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); //The mapping keeps the file open
+	if (mapped == MAP_FAILED) { return false; }
+	base = (const char*)mapped;
+	length = info.st_size;
+
+	/*
+	 * Everything is checked against the file size once here, so the lookups after never have to.
+	 */
+	const snapheader *h = (const snapheader*)base;
+	bool ok = memcmp(h->magic, SNAPSHOT_MAGIC, 4) == 0 && h->version == SNAPSHOT_VERSION && h->byteorder == SNAPSHOT_BYTEORDER;
+	struct section { uint64_t offset; uint64_t size; } sections[] = {
+		{ h->siteOffset, (uint64_t)h->sites * sizeof(snapsite) },
+		{ h->forecastIndexOffset, (uint64_t)h->forecastSites * sizeof(snapentry) },
+		{ h->forecastOffset, (uint64_t)h->forecasts * sizeof(snapforecast) },
+		{ h->observationIndexOffset, (uint64_t)h->observationSites * sizeof(snapentry) },
+		{ h->observationOffset, (uint64_t)h->observations * sizeof(snapobservation) },
+		{ h->stringOffset, h->stringLength }
+	};
+	for (const section &s : sections) {
+		ok = ok && (s.offset % 8) == 0 && s.offset <= length && s.size <= length - s.offset;
+	}
+	if (!ok) {
+		Close();
+		return false;
+	}
+
+	site_table = (const snapsite*)(base + h->siteOffset);
+	forecast_index = (const snapentry*)(base + h->forecastIndexOffset);
+	forecast_table = (const snapforecast*)(base + h->forecastOffset);
+	observation_index = (const snapentry*)(base + h->observationIndexOffset);
+	observation_table = (const snapobservation*)(base + h->observationOffset);
+	strings = base + h->stringOffset;
+	for (uint32_t i = 0; i < h->sites && ok; i++) {
+		const snapsite &s = site_table[i];
+		ok = (uint64_t)s.name + s.nameLength <= h->stringLength && (uint64_t)s.area + s.areaLength <= h->stringLength;
+	}
+	for (uint32_t i = 0; i < h->forecastSites && ok; i++) {
+		ok = (uint64_t)forecast_index[i].first + forecast_index[i].count <= h->forecasts;
+	}
+	for (uint32_t i = 0; i < h->observationSites && ok; i++) {
+		ok = (uint64_t)observation_index[i].first + observation_index[i].count <= h->observations;
+	}
+	if (!ok) {
+		Close();
+		return false;
+	}
+	head = h;
+	return true;
+}
+
+void datapoint::mappedsnapshot::Close() {
+	if (base) { munmap((void*)base, length); }
+	base = nullptr;
+	length = 0;
+	head = nullptr;
+	site_table = nullptr;
+	forecast_index = nullptr;
+	forecast_table = nullptr;
+	observation_index = nullptr;
+	observation_table = nullptr;
+	strings = nullptr;
+}
+
+const datapoint::snapsite * datapoint::mappedsnapshot::Find(unsigned int id) const {
+	if (!head) { return nullptr; }
+	const snapsite *end = site_table + head->sites;
+	const snapsite *found = lower_bound(site_table, end, id, [](const snapsite &s, unsigned int want) { return s.id < want; });
+	return (found != end && found->id == id) ? found : nullptr;
+}
+
+const datapoint::snapentry * datapoint::mappedsnapshot::Entry(const snapentry *index, uint32_t count, unsigned int id) {
+	const snapentry *end = index + count;
+	const snapentry *found = lower_bound(index, end, id, [](const snapentry &e, unsigned int want) { return e.id < want; });
+	return (found != end && found->id == id) ? found : nullptr;
+}
+
+const datapoint::snapforecast * datapoint::mappedsnapshot::Forecasts(unsigned int id, size_t &count) const {
+	count = 0;
+	const snapentry *entry = (head) ? Entry(forecast_index, head->forecastSites, id) : nullptr;
+	if (!entry) { return nullptr; }
+	count = entry->count;
+	return forecast_table + entry->first;
+}
+
+const datapoint::snapforecast * datapoint::mappedsnapshot::Forecast(unsigned int id, time_t when) const {
+	/*
+	 * Each forecast runs until the next one starts. The last one is taken to run as long as the gap before it.
+	 */
+	size_t count;
+	const snapforecast *run = Forecasts(id, count);
+	if (!run || count == 0 || when < run[0].time) { return nullptr; }
+	const snapforecast *after = upper_bound(run, run + count, (int64_t)when, [](int64_t t, const snapforecast &f) { return t < f.time; });
+	const snapforecast *found = after - 1;
+	if (after == run + count) {
+		int64_t span = (count > 1) ? run[count - 1].time - run[count - 2].time : SNAPSHOT_FORECAST_SPAN;
+		if (when >= found->time + span) { return nullptr; }
+	}
+	return found;
+}
+
+const datapoint::snapobservation * datapoint::mappedsnapshot::Observations(unsigned int id, size_t &count) const {
+	count = 0;
+	const snapentry *entry = (head) ? Entry(observation_index, head->observationSites, id) : nullptr;
+	if (!entry) { return nullptr; }
+	count = entry->count;
+	return observation_table + entry->first;
+}
+
+const datapoint::snapobservation * datapoint::mappedsnapshot::Observation(unsigned int id, time_t when) const {
+	size_t count;
+	const snapobservation *run = Observations(id, count);
+	if (!run || count == 0 || when < run[0].time) { return nullptr; }
+	return upper_bound(run, run + count, (int64_t)when, [](int64_t t, const snapobservation &o) { return t < o.time; }) - 1;
+}
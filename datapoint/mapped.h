@@ -0,0 +1,159 @@
+/*
+ * DataPoint for C++
+ *
+ * Binary snapshot files. A snapshotwriter turns sitelists and forecast/observation responses into one versioned,
+ * fixed layout file, and a mappedsnapshot mmaps it read only. Lookups by site ID and time go straight to the
+ * mapped records, with no JSON, no strings built and no copies. Every process mapping the same file shares
+ * the pages through the OS cache.
+ *
+ * Layout, all offsets from the start of the file and every section 8 byte aligned:
+ *   snapheader
+ *   snapsite[sites]                      sorted by id
+ *   snapentry[forecastSites]             sorted by id, each a run of forecasts
+ *   snapforecast[forecasts]              oldest first within a site
+ *   snapentry[observationSites]
+ *   snapobservation[observations]
+ *   char strings[]                       site names and areas, not NUL terminated
+ *
+ * Numbers are stored in the writer's byte order, which is recorded in the header and checked on open.
+ *
+ */
+
+#ifndef DATAPOINT_MAPPED_H_
+#define DATAPOINT_MAPPED_H_
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "siteindex.h"
+#include "typed.h"
+
+#define SNAPSHOT_MAGIC "DPSS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTEORDER 0x01020304
+
+namespace datapoint {
+		class snapheader {
+			public:
+				char magic[4];
+				uint32_t version;
+				uint32_t byteorder;
+				uint32_t sites;
+				int64_t created; //UTC
+				uint32_t forecastSites;
+				uint32_t forecasts;
+				uint32_t observationSites;
+				uint32_t observations;
+				uint64_t siteOffset;
+				uint64_t forecastIndexOffset;
+				uint64_t forecastOffset;
+				uint64_t observationIndexOffset;
+				uint64_t observationOffset;
+				uint64_t stringOffset;
+				uint64_t stringLength;
+		} ;//snapheader
+		class snapsite {
+			public:
+				uint32_t id;
+				float lat;
+				float lon;
+				uint32_t name; //Offset into strings
+				uint32_t area;
+				uint16_t nameLength;
+				uint16_t areaLength;
+		} ;//snapsite
+		class snapentry {
+			public:
+				uint32_t id;
+				uint32_t first; //Index of the site's first record
+				uint32_t count;
+				uint32_t reserved;
+		} ;//snapentry
+		class snapforecast {
+			public:
+				int64_t time; //UTC, start of the 3 hours (or the Day/Night half of a daily forecast)
+				uint16_t missing; //forecastrecord::field bits
+				int8_t feelsLike;
+				int8_t temperature;
+				uint8_t windGust;
+				uint8_t windSpeed;
+				uint8_t humidity;
+				uint8_t precipitationProb;
+				uint8_t uv;
+				uint8_t weatherType;
+				visibilitycode visibility;
+				compass windDirection;
+				uint8_t reserved[4];
+				forecastrecord Record() const;
+		} ;//snapforecast
+		class snapobservation {
+			public:
+				int64_t time; //UTC, the hour observed
+				float temperature;
+				float dewPoint;
+				float humidity;
+				uint32_t visibility;
+				uint16_t pressure;
+				uint16_t missing; //observationrecord::field bits
+				uint8_t windGust;
+				uint8_t windSpeed;
+				uint8_t weatherType;
+				compass windDirection;
+				tendencycode tendency;
+				uint8_t reserved[7];
+				observationrecord Record() const;
+		} ;//snapobservation
+		static_assert(sizeof(snapheader) == 96 && sizeof(snapsite) == 24 && sizeof(snapentry) == 16, "Snapshot layout changed, bump SNAPSHOT_VERSION");
+		static_assert(sizeof(snapforecast) == 24 && sizeof(snapobservation) == 40, "Snapshot layout changed, bump SNAPSHOT_VERSION");
+
+		class snapshotwriter {
+			private:
+				std::map<unsigned int, site> sites;
+				std::map<unsigned int, std::vector<snapforecast> > forecasts;
+				std::map<unsigned int, std::vector<snapobservation> > observations;
+			public:
+				void Sites(const siteindex &index); //Both sitelists can be added, a site in both is kept once
+				size_t Forecasts(const rapidjson::Document &json); //3hourly or daily, one site or "all". Returns records added.
+				size_t Observations(const rapidjson::Document &json); //hourly, one site or "all"
+				bool Write(std::string path) const; //Written beside and renamed over, so readers never see half a file
+		} ;//snapshotwriter
+		class mappedsnapshot {
+			private:
+				const char *base = nullptr;
+				size_t length = 0;
+				const snapheader *head = nullptr;
+				const snapsite *site_table = nullptr;
+				const snapentry *forecast_index = nullptr;
+				const snapforecast *forecast_table = nullptr;
+				const snapentry *observation_index = nullptr;
+				const snapobservation *observation_table = nullptr;
+				const char *strings = nullptr;
+				static const snapentry * Entry(const snapentry *index, uint32_t count, unsigned int id);
+			public:
+				mappedsnapshot() {}
+				~mappedsnapshot() { Close(); }
+				mappedsnapshot(const mappedsnapshot &) = delete;
+				mappedsnapshot & operator=(const mappedsnapshot &) = delete;
+				bool Open(std::string path); //False if missing, truncated, or a different version or byte order
+				void Close();
+				bool Empty() const { return head == nullptr; }
+				time_t Created() const { return (head) ? head->created : 0; }
+				size_t Sites() const { return (head) ? head->sites : 0; }
+				const snapsite & Site(size_t i) const { return site_table[i]; }
+				const snapsite * Find(unsigned int id) const;
+				std::string_view Name(const snapsite &s) const { return std::string_view(strings + s.name, s.nameLength); }
+				std::string_view Area(const snapsite &s) const { return std::string_view(strings + s.area, s.areaLength); }
+				const snapforecast * Forecasts(unsigned int id, size_t &count) const; //A site's run, oldest first
+				const snapforecast * Forecast(unsigned int id, time_t when) const; //The one covering 'when'
+				const snapobservation * Observations(unsigned int id, size_t &count) const;
+				const snapobservation * Observation(unsigned int id, time_t when) const; //Latest at or before 'when'
+		} ;//mappedsnapshot
+} //datapoint
+
+#endif /* DATAPOINT_MAPPED_H_ */
@@ -0,0 +1,186 @@
+/*
+ * DataPoint for C++
+ *
+ * Request metrics, see metrics.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/metrics.h"
+
+using namespace std;
+
+void datapoint::metrics::sample::Read(CURL *connection) {
+	/*
+	 * cURL's times all run from the start of the request, so each phase is the gap between two of them. A reused
+	 * connection skips DNS and connect (both come back as 0) and plain HTTP has no TLS at all.
+	 */
+	curl_off_t lookup = 0, connect = 0, tls = 0, pretransfer = 0, start = 0, total = 0, size = 0;
+	curl_easy_getinfo(connection, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+	curl_easy_getinfo(connection, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(connection, CURLINFO_APPCONNECT_TIME_T, &tls);
+	curl_easy_getinfo(connection, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+	curl_easy_getinfo(connection, CURLINFO_STARTTRANSFER_TIME_T, &start);
+	curl_easy_getinfo(connection, CURLINFO_TOTAL_TIME_T, &total);
+	curl_easy_getinfo(connection, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	curl_easy_getinfo(connection, CURLINFO_RESPONSE_CODE, &status);
+
+	micros[DNS] = lookup;
+	micros[CONNECT] = (connect >= lookup) ? connect - lookup : 0;
+	micros[TLS] = (tls > 0) ? tls - connect : -1;
+	if (start > 0) { //Never got a byte back otherwise
+		micros[WAIT] = start - pretransfer;
+		micros[TRANSFER] = total - start;
+	}
+	bytes = size;
+}
+
+void datapoint::metrics::Record(const sample &recorded) {
+	tally &t = endpoints[recorded.where];
+	if (recorded.result != LOCAL) {
+		t.requests++;
+		t.bytes += recorded.bytes;
+	}
+	switch (recorded.result) {
+		case FETCHED: t.fetched++; break;
+		case CACHED: t.cached++; break;
+		case REVALIDATED: t.revalidated++; break;
+		case FAILED: t.failed++; break;
+		case LOCAL: break;
+	}
+	if (recorded.coalesced) { t.coalesced++; }
+	for (int p = 0; p < PHASES; p++) {
+		if (recorded.micros[p] >= 0) { Time(recorded.where, (phase)p, recorded.micros[p]); }
+	}
+
+	shared_ptr<const sink> notify = atomic_load(&hook);
+	if (notify) { (*notify)(recorded); }
+}
+
+void datapoint::metrics::Time(endpoint where, phase what, long long micros) {
+	slot &s = endpoints[where].phases[what];
+	unsigned long long us = (micros > 0) ? micros : 0;
+	int bucket = 0;
+	while (bucket < METRICS_BUCKETS - 1 && us >= (1ULL << bucket)) { bucket++; }
+	s.count++;
+	s.total += us;
+	s.buckets[bucket]++;
+	unsigned long long seen = s.max;
+	while (us > seen && !s.max.compare_exchange_weak(seen, us)) {}
+}
+
+void datapoint::metrics::Retry(endpoint where) {
+	endpoints[where].retries++;
+}
+
+void datapoint::metrics::Setsink(sink insink) {
+	shared_ptr<const sink> replacement;
+	if (insink) { replacement = make_shared<const sink>(insink); }
+	atomic_store(&hook, replacement);
+}
+
+datapoint::metrics::counters datapoint::metrics::Counters(endpoint where) const {
+	const tally &t = endpoints[where];
+	counters c;
+	c.requests = t.requests;
+	c.fetched = t.fetched;
+	c.cached = t.cached;
+	c.revalidated = t.revalidated;
+	c.failed = t.failed;
+	c.coalesced = t.coalesced;
+	c.retries = t.retries;
+	c.bytes = t.bytes;
+	return c;
+}
+
+datapoint::metrics::timing datapoint::metrics::Timing(endpoint where, phase what) const {
+	const slot &s = endpoints[where].phases[what];
+	timing t;
+	t.count = s.count;
+	t.total = s.total;
+	t.max = s.max;
+	for (int b = 0; b < METRICS_BUCKETS; b++) { t.buckets[b] = s.buckets[b]; }
+	return t;
+}
+
+unsigned long long datapoint::metrics::timing::Percentile(double p) const {
+	unsigned long long seen = 0, want = (unsigned long long)(p * count + 0.5);
+	if (want == 0) { want = 1; }
+	for (int b = 0; b < METRICS_BUCKETS - 1; b++) {
+		seen += buckets[b];
+		if (seen >= want) { return (b == 0) ? 0 : min(1ULL << b, max); }
+	}
+	return max;
+}
+
+void datapoint::metrics::Reset() {
+	for (tally &t : endpoints) {
+		t.requests = 0; t.fetched = 0; t.cached = 0; t.revalidated = 0; t.failed = 0; t.coalesced = 0; t.retries = 0; t.bytes = 0;
+		for (slot &s : t.phases) {
+			s.count = 0; s.total = 0; s.max = 0;
+			for (atomic<unsigned long long> &b : s.buckets) { b = 0; }
+		}
+	}
+}
+
+void datapoint::metrics::Export(ostream &out) const {
+	const char *outcomes[] = { "fetched", "cached", "revalidated", "failed" };
+	out << "# TYPE datapoint_requests_total counter\n";
+	for (int e = 0; e < ENDPOINTS; e++) {
+		counters c = Counters((endpoint)e);
+		unsigned long long counts[] = { c.fetched, c.cached, c.revalidated, c.failed };
+		for (int o = 0; o < 4; o++) {
+			out << "datapoint_requests_total{endpoint=\"" << Name((endpoint)e) << "\",outcome=\"" << outcomes[o] << "\"} "
+					<< counts[o] << "\n";
+		}
+	}
+	out << "# TYPE datapoint_coalesced_total counter\n"; //A subset of datapoint_requests_total, whatever their outcome
+	for (int e = 0; e < ENDPOINTS; e++) {
+		out << "datapoint_coalesced_total{endpoint=\"" << Name((endpoint)e) << "\"} " << Counters((endpoint)e).coalesced << "\n";
+	}
+	out << "# TYPE datapoint_retries_total counter\n";
+	for (int e = 0; e < ENDPOINTS; e++) {
+		out << "datapoint_retries_total{endpoint=\"" << Name((endpoint)e) << "\"} " << Counters((endpoint)e).retries << "\n";
+	}
+	out << "# TYPE datapoint_received_bytes_total counter\n";
+	for (int e = 0; e < ENDPOINTS; e++) {
+		out << "datapoint_received_bytes_total{endpoint=\"" << Name((endpoint)e) << "\"} " << Counters((endpoint)e).bytes << "\n";
+	}
+	out << "# TYPE datapoint_phase_seconds histogram\n";
+	for (int e = 0; e < ENDPOINTS; e++) {
+		for (int p = 0; p < PHASES; p++) {
+			timing t = Timing((endpoint)e, (phase)p);
+			if (t.count == 0) { continue; }
+			string labels = string("endpoint=\"") + Name((endpoint)e) + "\",phase=\"" + Name((phase)p) + "\"";
+			unsigned long long cumulative = 0;
+			for (int b = 0; b < METRICS_BUCKETS - 1; b++) {
+				cumulative += t.buckets[b];
+				out << "datapoint_phase_seconds_bucket{" << labels << ",le=\"" << (double)(1ULL << b) / 1e6 << "\"} " << cumulative << "\n";
+			}
+			out << "datapoint_phase_seconds_bucket{" << labels << ",le=\"+Inf\"} " << t.count << "\n";
+			out << "datapoint_phase_seconds_sum{" << labels << "} " << (double)t.total / 1e6 << "\n";
+			out << "datapoint_phase_seconds_count{" << labels << "} " << t.count << "\n";
+		}
+	}
+}
+
+datapoint::metrics::endpoint datapoint::metrics::Endpoint(const string &func, bool isForecast) {
+	if (func.compare(0, 8, "sitelist") == 0) { return SITELISTS; }
+	return (isForecast) ? FORECASTS : OBSERVATIONS;
+}
+
+const char * datapoint::metrics::Name(endpoint where) {
+	const char *names[] = { "forecasts", "observations", "sitelists" };
+	return (where < ENDPOINTS) ? names[where] : "unknown";
+}
+
+const char * datapoint::metrics::Name(phase what) {
+	const char *names[] = { "dns", "connect", "tls", "wait", "transfer", "parse", "decode", "locate" };
+	return (what < PHASES) ? names[what] : "unknown";
+}
+
+long long datapoint::metrics::Since(chrono::steady_clock::time_point start) {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
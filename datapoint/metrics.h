@@ -0,0 +1,102 @@
+/*
+ * DataPoint for C++
+ *
+ * Request metrics. Every call is timed by phase: the network phases come from cURL (DNS, connect, TLS, waiting
+ * for the first byte, transfer), and parse, decode and site lookup are timed locally. Bytes, cache hits,
+ * revalidations, coalesced requests, retries and errors are counted per endpoint as well.
+ *
+ * Counters are atomics, so one metrics object can be shared by any number of api objects and threads. Read them
+ * back with Counters/Timing, write them all out with Export, or Setsink to see every sample as it's recorded.
+ *
+ */
+
+#ifndef DATAPOINT_METRICS_H_
+#define DATAPOINT_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <curl/curl.h>
+
+#define METRICS_BUCKETS 24 //Powers of two of microseconds, the last one catches everything past ~8 seconds
+
+namespace datapoint {
+		class metrics {
+			public:
+				enum endpoint : uint8_t { FORECASTS, OBSERVATIONS, SITELISTS, ENDPOINTS };
+				enum phase : uint8_t { DNS, CONNECT, TLS, WAIT, TRANSFER, PARSE, DECODE, LOCATE, PHASES };
+				enum outcome : uint8_t {
+					FETCHED, //Downloaded in full
+					CACHED, //Fresh in the cache, no request made
+					REVALIDATED, //Stale in the cache, Datapoint said 304
+					FAILED, //cURL error, or a body that wouldn't parse
+					LOCAL //No request involved, just timing some local work
+				};
+				class sample {
+					public:
+						endpoint where;
+						outcome result = LOCAL;
+						bool coalesced = false; //Shared another caller's identical request (see scheduler.h), and its outcome
+						CURLcode code = CURLE_OK;
+						long status = 0;
+						unsigned long long bytes = 0; //Body bytes received, after decompression
+						long long micros[PHASES]; //-1 for phases that didn't happen
+						sample(endpoint inwhere = FORECASTS) : where(inwhere) { for (long long &m : micros) { m = -1; } }
+						void Read(CURL *connection); //Network phases, status and size from a finished transfer
+				} ;
+				class counters {
+					public:
+						unsigned long long requests = 0; //Everything but LOCAL
+						unsigned long long fetched = 0;
+						unsigned long long cached = 0;
+						unsigned long long revalidated = 0;
+						unsigned long long failed = 0;
+						unsigned long long coalesced = 0; //Also counted under their outcome
+						unsigned long long retries = 0;
+						unsigned long long bytes = 0;
+				} ;
+				class timing {
+					public:
+						unsigned long long count = 0;
+						unsigned long long total = 0; //Microseconds
+						unsigned long long max = 0;
+						unsigned long long buckets[METRICS_BUCKETS] = {}; //bucket[b] counts times under 2^b microseconds
+						double Mean() const { return (count) ? (double)total / count : 0; }
+						unsigned long long Percentile(double p) const; //Upper bound of the bucket holding it, microseconds
+				} ;
+				typedef std::function<void(const sample &recorded)> sink;
+			private:
+				class slot {
+					public:
+						std::atomic<unsigned long long> count{0}, total{0}, max{0};
+						std::atomic<unsigned long long> buckets[METRICS_BUCKETS] = {};
+				} ;
+				class tally {
+					public:
+						std::atomic<unsigned long long> requests{0}, fetched{0}, cached{0}, revalidated{0}, failed{0}, coalesced{0}, retries{0}, bytes{0};
+						slot phases[PHASES];
+				} ;
+				tally endpoints[ENDPOINTS];
+				std::shared_ptr<const sink> hook;
+			public:
+				void Record(const sample &recorded);
+				void Time(endpoint where, phase what, long long micros);
+				void Retry(endpoint where);
+				void Setsink(sink insink); //Runs on whichever thread recorded the sample, so keep it quick
+				counters Counters(endpoint where) const;
+				timing Timing(endpoint where, phase what) const;
+				void Reset();
+				void Export(std::ostream &out) const; //Prometheus text format
+				static endpoint Endpoint(const std::string &func, bool isForecast);
+				static const char * Name(endpoint where);
+				static const char * Name(phase what);
+				static long long Since(std::chrono::steady_clock::time_point start); //Microseconds
+		} ;//metrics
+} //datapoint
+
+#endif /* DATAPOINT_METRICS_H_ */
@@ -0,0 +1,337 @@
+/*
+ * DataPoint for C++
+ *
+ * Background refresher, see refresher.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/refresher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+datapoint::refresher::refresher(string key) {
+	source.Setkey(key);
+	Publish(make_shared<const snapshot>()); //Empty, so Read() never returns nullptr
+}
+
+datapoint::refresher::~refresher() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	published.notify_all();
+	if (loop.joinable()) { loop.join(); }
+}
+
+static bool Insert(vector<unsigned int> &ids, unsigned int id) {
+	vector<unsigned int>::iterator itr = lower_bound(ids.begin(), ids.end(), id);
+	if (itr != ids.end() && *itr == id) { return false; }
+	ids.insert(itr, id);
+	return true;
+}
+
+static bool Contains(const vector<unsigned int> &ids, unsigned int id) {
+	return binary_search(ids.begin(), ids.end(), id);
+}
+
+void datapoint::refresher::SubscribeForecast(unsigned int id) {
+	{
+		lock_guard<mutex> guard(lock);
+		if (Insert(forecast_ids, id)) { forecast_new.push_back(id); } //So the new site doesn't wait hours for its first data
+	}
+	wake.notify_all();
+}
+
+void datapoint::refresher::SubscribeObservation(unsigned int id) {
+	{
+		lock_guard<mutex> guard(lock);
+		if (Insert(observation_ids, id)) { observation_new.push_back(id); }
+	}
+	wake.notify_all();
+}
+
+void datapoint::refresher::Subscribe(double lat, double lon) {
+	const site *forecastSite, *observationSite;
+	{
+		lock_guard<mutex> guard(source_lock); //The refresh thread may be using source
+		forecastSite = source.Getsites(true)->Nearest(lat, lon);
+		observationSite = source.Getsites(false)->Nearest(lat, lon);
+	}
+	if (!forecastSite || !observationSite) {
+		source.Errors() << "No DataPoint site near " << lat << ", " << lon << "." << endl ;
+		throw 1;
+	}
+	SubscribeForecast(forecastSite->id);
+	SubscribeObservation(observationSite->id);
+}
+
+/*
+ * Subscribing one at a time can let the refresh thread wake up between sites and refetch twice. These all go in
+ * together, so they're covered by a single refresh.
+ */
+void datapoint::refresher::Subscribe(const vector<unsigned int> &forecasts, const vector<unsigned int> &observations) {
+	{
+		lock_guard<mutex> guard(lock);
+		for (unsigned int id : forecasts) {
+			if (Insert(forecast_ids, id)) { forecast_new.push_back(id); }
+		}
+		for (unsigned int id : observations) {
+			if (Insert(observation_ids, id)) { observation_new.push_back(id); }
+		}
+	}
+	wake.notify_all();
+}
+
+void datapoint::refresher::Start() {
+	lock_guard<mutex> guard(lock);
+	if (!loop.joinable()) {
+		loop = thread(&refresher::Run, this);
+	}
+}
+
+void datapoint::refresher::Refresh() {
+	{
+		lock_guard<mutex> guard(lock);
+		forced = true;
+	}
+	wake.notify_all();
+}
+
+shared_ptr<const datapoint::snapshot> datapoint::refresher::Wait(unsigned long version, chrono::steady_clock::time_point until) {
+	unique_lock<mutex> guard(lock);
+	published.wait_until(guard, until, [&]() { return stopping || current->version > version; });
+	return current;
+}
+
+bool datapoint::refresher::Failing(unsigned int id, bool isForecast) {
+	lock_guard<mutex> guard(lock);
+	return Contains((isForecast) ? forecast_failing : observation_failing, id);
+}
+
+unsigned long datapoint::refresher::Failures() {
+	lock_guard<mutex> guard(lock);
+	return failures;
+}
+
+void datapoint::refresher::Publish(shared_ptr<const snapshot> next) {
+	/*
+	 * Readers may still be using the snapshot being replaced. They each hold a reference from Read, so it's
+	 * freed by whichever of them lets go last, and there's no grace period to get wrong.
+	 */
+	atomic_store(&current, next);
+	published.notify_all();
+}
+
+time_t datapoint::refresher::Due(time_t last, time_t interval, time_t now) {
+	if (last == 0) { return now; } //Never fetched
+	return ((last - REFRESH_OFFSET) / interval + 1) * interval + REFRESH_OFFSET; //The next publication after 'last'
+}
+
+/*
+ * 'fetched' laid over 'base', for sites merged in between scheduled refreshes. Both are sorted by ID, and so is
+ * the result.
+ */
+template <class T> static shared_ptr<datapoint::sitestore<T> > Merge(const datapoint::sitestore<T> *base, datapoint::sitestore<T> &fetched) {
+	shared_ptr<datapoint::sitestore<T> > merged = make_shared<datapoint::sitestore<T> >();
+	size_t b = 0, f = 0, bases = (base) ? base->size() : 0;
+	while (b < bases || f < fetched.size()) {
+		if (f < fetched.size() && (b >= bases || fetched.ids[f] <= base->ids[b])) {
+			if (b < bases && base->ids[b] == fetched.ids[f]) { b++; } //Replaced
+			merged->ids.push_back(fetched.ids[f]);
+			merged->results.push_back(std::move(fetched.results[f]));
+			f++;
+		} else {
+			merged->ids.push_back(base->ids[b]);
+			merged->results.push_back(base->results[b]);
+			b++;
+		}
+	}
+	return merged;
+}
+
+bool datapoint::refresher::RefreshForecasts(const vector<unsigned int> &ids, bool merge, shared_ptr<snapshot> &next,
+		vector<unsigned int> &failing) {
+	const sitestore<vector<forecast> > *last = next->forecasts.get();
+	sitestore<vector<forecast> > fetched;
+	if (ids.size() > REFRESH_BULK_SITES) {
+		sitestore<vector<forecast> > all;
+		try {
+			all = source.GetAllForecasts();
+		} catch (...) {
+			failing = ids;
+			return false; //The last good forecasts stay published
+		}
+		for (unsigned int id : ids) {
+			const vector<forecast> *found = all.Find(id);
+			if (!found) {
+				failing.push_back(id);
+				found = (last && !merge) ? last->Find(id) : nullptr;
+			}
+			if (found) {
+				fetched.ids.push_back(id);
+				fetched.results.push_back(*found);
+			}
+		}
+	} else {
+		for (unsigned int id : ids) {
+			try {
+				fetched.results.push_back(source.FetchForecast(id));
+				fetched.ids.push_back(id);
+			} catch (...) {
+				failing.push_back(id); //Just this site, the rest still go out
+				const vector<forecast> *found = (last && !merge) ? last->Find(id) : nullptr;
+				if (found) {
+					fetched.ids.push_back(id);
+					fetched.results.push_back(*found);
+				}
+			}
+		}
+	}
+	if (failing.size() == ids.size()) { return false; }
+	if (merge) {
+		next->forecasts = Merge(last, fetched);
+	} else {
+		next->forecasts = make_shared<sitestore<vector<forecast> > >(std::move(fetched));
+		next->forecastsUpdated = time(nullptr);
+	}
+	return true;
+}
+
+bool datapoint::refresher::RefreshObservations(const vector<unsigned int> &ids, bool merge, shared_ptr<snapshot> &next,
+		vector<unsigned int> &failing) {
+	const sitestore<observation> *last = next->observations.get();
+	sitestore<observation> fetched;
+	if (ids.size() > REFRESH_BULK_SITES) {
+		sitestore<observation> all;
+		try {
+			all = source.GetAllObservations();
+		} catch (...) {
+			failing = ids;
+			return false;
+		}
+		for (unsigned int id : ids) {
+			const observation *found = all.Find(id);
+			if (!found) {
+				failing.push_back(id);
+				found = (last && !merge) ? last->Find(id) : nullptr;
+			}
+			if (found) {
+				fetched.ids.push_back(id);
+				fetched.results.push_back(*found);
+			}
+		}
+	} else {
+		for (unsigned int id : ids) {
+			try {
+				fetched.results.push_back(source.FetchObservation(id));
+				fetched.ids.push_back(id);
+			} catch (...) {
+				failing.push_back(id);
+				const observation *found = (last && !merge) ? last->Find(id) : nullptr;
+				if (found) {
+					fetched.ids.push_back(id);
+					fetched.results.push_back(*found);
+				}
+			}
+		}
+	}
+	if (failing.size() == ids.size()) { return false; }
+	if (merge) {
+		next->observations = Merge(last, fetched);
+	} else {
+		next->observations = make_shared<sitestore<observation> >(std::move(fetched));
+		next->observationsUpdated = time(nullptr);
+	}
+	return true;
+}
+
+/*
+ * What to fetch this time round: every subscribed site when they're due, otherwise just the ones new since last
+ * time, plus any that failed once their retry is due. Clears 'added' either way.
+ */
+static vector<unsigned int> Pick(bool due, bool retry, const vector<unsigned int> &subscribed, vector<unsigned int> &added,
+		const vector<unsigned int> &failing) {
+	vector<unsigned int> ids;
+	if (due) {
+		ids = subscribed;
+	} else {
+		ids.swap(added);
+		if (retry) { ids.insert(ids.end(), failing.begin(), failing.end()); }
+		sort(ids.begin(), ids.end());
+		ids.erase(unique(ids.begin(), ids.end()), ids.end());
+	}
+	added.clear();
+	return ids;
+}
+
+/*
+ * After fetching 'tried', the ones in 'failed' are failing and the rest aren't. Both are sorted.
+ */
+static void Failed(vector<unsigned int> &failing, const vector<unsigned int> &tried, const vector<unsigned int> &failed) {
+	vector<unsigned int> still;
+	set_difference(failing.begin(), failing.end(), tried.begin(), tried.end(), back_inserter(still));
+	failing.clear();
+	set_union(still.begin(), still.end(), failed.begin(), failed.end(), back_inserter(failing));
+}
+
+void datapoint::refresher::Run() {
+	time_t forecastsDue = 0, observationsDue = 0; //0 is straight away
+	time_t retryDue = 0; //For sites whose last fetch failed
+	unique_lock<mutex> guard(lock);
+	while (!stopping) {
+		time_t now = time(nullptr);
+		bool force = forced;
+		bool doForecasts = (force || forecastsDue <= now) && !forecast_ids.empty();
+		bool doObservations = (force || observationsDue <= now) && !observation_ids.empty();
+		bool anyFailing = !forecast_failing.empty() || !observation_failing.empty();
+		bool retry = anyFailing && retryDue <= now;
+		if (!doForecasts && !doObservations && !retry && forecast_new.empty() && observation_new.empty()) {
+			time_t due = min((forecast_ids.empty()) ? now + 3600 : forecastsDue, (observation_ids.empty()) ? now + 3600 : observationsDue);
+			if (anyFailing) { due = min(due, retryDue); }
+			wake.wait_until(guard, chrono::system_clock::from_time_t(due));
+			continue;
+		}
+		forced = false;
+		vector<unsigned int> forecastIds = Pick(doForecasts, retry, forecast_ids, forecast_new, forecast_failing);
+		vector<unsigned int> observationIds = Pick(doObservations, retry, observation_ids, observation_new, observation_failing);
+		shared_ptr<snapshot> next = make_shared<snapshot>(*current); //Only Publish changes current, and it's under 'lock'
+		guard.unlock();
+
+		/*
+		 * The network work happens here with 'lock' released, so callers waiting on a snapshot and callers
+		 * subscribing aren't held up by a slow Datapoint.
+		 */
+		vector<unsigned int> forecastsFailing, observationsFailing;
+		{
+			lock_guard<mutex> using_source(source_lock);
+			if (!forecastIds.empty()) {
+				bool ok = RefreshForecasts(forecastIds, !doForecasts, next, forecastsFailing);
+				if (doForecasts) { forecastsDue = (ok) ? Due(time(nullptr), CACHE_TTL_FORECAST, now) : now + REFRESH_RETRY; }
+			}
+			if (!observationIds.empty()) {
+				bool ok = RefreshObservations(observationIds, !doObservations, next, observationsFailing);
+				if (doObservations) { observationsDue = (ok) ? Due(time(nullptr), CACHE_TTL_OBSERVATION, now) : now + REFRESH_RETRY; }
+			}
+		}
+
+		guard.lock();
+		failures += !forecastsFailing.empty() + !observationsFailing.empty();
+		Failed(forecast_failing, forecastIds, forecastsFailing);
+		Failed(observation_failing, observationIds, observationsFailing);
+		if (retry || forecastsFailing.size() + observationsFailing.size() > 0) {
+			retryDue = time(nullptr) + REFRESH_RETRY; //Sites that failed just now wait the whole interval
+		}
+		if (next->forecasts != current->forecasts || next->observations != current->observations) {
+			next->version = current->version + 1;
+			Publish(next);
+		}
+	}
+}
@@ -0,0 +1,97 @@
+/*
+ * DataPoint for C++
+ *
+ * Background refresher. It owns an api object and a list of subscribed sites, and refetches them on Datapoint's
+ * own schedule: observations hourly, forecasts every three hours. Each refresh publishes a new immutable
+ * snapshot, swapped in RCU style, so readers never wait on the network or on each other.
+ *
+ * Sites subscribed between scheduled refreshes are fetched on their own and merged into the next snapshot, so
+ * a new site costs its own request rather than a refetch of everything. Sites are fetched one by one, and one
+ * that fails keeps its last good data and is retried every REFRESH_RETRY without holding up the rest.
+ *
+ * Read() is an atomic load of the current snapshot's shared_ptr, and never waits on the refresh thread. A reader
+ * keeps the snapshot alive for as long as it holds what Read() returned, however many are published meanwhile.
+ *
+ */
+
+#ifndef DATAPOINT_REFRESHER_H_
+#define DATAPOINT_REFRESHER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "datapoint.h"
+
+#define REFRESH_OFFSET 900 //Seconds after each hour/three hours before refetching, Datapoint takes a while to publish
+#define REFRESH_RETRY 300 //Seconds before trying again after a failed refresh
+#define REFRESH_BULK_SITES 20 //More subscribed sites than this and one "all" request beats one request each
+
+namespace datapoint {
+		class snapshot {
+			/*
+			 * Never changed once published. Forecasts and observations refresh on different schedules, so an
+			 * unchanged half is shared with the snapshot before rather than copied.
+			 */
+			public:
+				std::shared_ptr<const sitestore<std::vector<forecast> > > forecasts;
+				std::shared_ptr<const sitestore<observation> > observations;
+				time_t forecastsUpdated = 0; //Last scheduled refresh, 0 until the first. Sites merged in since don't change it.
+				time_t observationsUpdated = 0;
+				unsigned long version = 0;
+				const std::vector<forecast> * Forecast(unsigned int id) const { return (forecasts) ? forecasts->Find(id) : nullptr; }
+				const observation * Observation(unsigned int id) const { return (observations) ? observations->Find(id) : nullptr; }
+		} ;//snapshot
+		class refresher {
+			private:
+				api source;
+				std::mutex source_lock; //source isn't thread safe, held while it's in use
+				std::shared_ptr<const snapshot> current; //Stored atomically by Publish under 'lock', loaded atomically by Read
+				std::mutex lock; //Subscriptions, wake ups and publishing. Never taken by Read.
+				std::condition_variable wake;
+				std::condition_variable published; //Notified with each new snapshot, for Wait
+				std::vector<unsigned int> forecast_ids; //Sorted, unique
+				std::vector<unsigned int> observation_ids;
+				std::vector<unsigned int> forecast_new; //Subscribed since the last refresh, to be fetched and merged in
+				std::vector<unsigned int> observation_new;
+				std::vector<unsigned int> forecast_failing; //Sorted. Their last fetch failed.
+				std::vector<unsigned int> observation_failing;
+				bool stopping = false;
+				bool forced = false;
+				unsigned long failures = 0;
+				std::thread loop;
+				void Run();
+				/*
+				 * Fetch ids into next, replacing what it had unless 'merge'. Sites that fail go in 'failing' and keep
+				 * their last good data. False if nothing at all could be fetched.
+				 */
+				bool RefreshForecasts(const std::vector<unsigned int> &ids, bool merge, std::shared_ptr<snapshot> &next,
+						std::vector<unsigned int> &failing);
+				bool RefreshObservations(const std::vector<unsigned int> &ids, bool merge, std::shared_ptr<snapshot> &next,
+						std::vector<unsigned int> &failing);
+				void Publish(std::shared_ptr<const snapshot> next);
+				static time_t Due(time_t last, time_t interval, time_t now);
+			public:
+				refresher(std::string key);
+				~refresher(); //Stops the refresh thread
+				refresher(const refresher &) = delete;
+				refresher & operator=(const refresher &) = delete;
+				api & Source() { return source; } //Set a cache, URL, scheduler etc. before Start
+				void SubscribeForecast(unsigned int id);
+				void SubscribeObservation(unsigned int id);
+				void Subscribe(double lat, double lon); //Nearest forecast and observation sites
+				void Subscribe(const std::vector<unsigned int> &forecasts, const std::vector<unsigned int> &observations); //Fetched together
+				void Start(); //First refresh straight away, then on schedule
+				void Refresh(); //Refetch everything now rather than waiting
+				bool Failing(unsigned int id, bool isForecast); //The site's last fetch failed, and it's waiting to be retried
+				std::shared_ptr<const snapshot> Read() const { return std::atomic_load(&current); } //See above
+				std::shared_ptr<const snapshot> Wait(unsigned long version, std::chrono::steady_clock::time_point until); //Held, newer than version unless it timed out
+				unsigned long Failures();
+		} ;//refresher
+} //datapoint
+
+#endif /* DATAPOINT_REFRESHER_H_ */
@@ -0,0 +1,161 @@
+/*
+ * DataPoint for C++
+ *
+ * Request scheduler, see scheduler.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/scheduler.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+datapoint::scheduler::scheduler(double perMinute, unsigned int inburst, unsigned int inretries, unsigned int backoffMs)
+		: rate(perMinute / 60), burst(max(1u, inburst)), tokens(max(1u, inburst)), refilled(chrono::steady_clock::now()),
+		  retries(inretries), backoff(backoffMs) {
+}
+
+void datapoint::scheduler::Refill(chrono::steady_clock::time_point now) {
+	tokens = min(burst, tokens + chrono::duration<double>(now - refilled).count() * rate);
+	refilled = now;
+}
+
+bool datapoint::scheduler::First(unsigned long ticket) const {
+	for (const vector<unsigned long> &queue : waiting) {
+		if (!queue.empty()) { return queue.front() == ticket; }
+	}
+	return false;
+}
+
+void datapoint::scheduler::Acquire(priority p) {
+	if (rate <= 0) { return; }
+	unique_lock<mutex> guard(bucket_lock);
+	unsigned long ticket = tickets++;
+	waiting[p].push_back(ticket);
+	while (true) {
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		Refill(now);
+		if (!First(ticket)) {
+			bucket_ready.wait(guard); //Someone ahead takes a token first, they wake us when they do
+			continue;
+		}
+		if (tokens >= 1) {
+			tokens -= 1;
+			waiting[p].erase(waiting[p].begin());
+			bucket_ready.notify_all();
+			return;
+		}
+		bucket_ready.wait_until(guard, now + chrono::duration_cast<chrono::steady_clock::duration>(
+				chrono::duration<double>((1 - tokens) / rate)));
+	}
+}
+
+bool datapoint::scheduler::TryAcquire(priority p, chrono::steady_clock::duration &wait) {
+	if (rate <= 0) { return true; }
+	lock_guard<mutex> guard(bucket_lock);
+	Refill(chrono::steady_clock::now());
+	size_t ahead = 0; //Blocked in Acquire at the same priority or higher, they go first
+	for (int q = 0; q <= p; q++) { ahead += waiting[q].size(); }
+	if (ahead == 0 && tokens >= 1) {
+		tokens -= 1;
+		return true;
+	}
+	wait = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(max((ahead + 1 - tokens) / rate, 0.001)));
+	return false;
+}
+
+bool datapoint::scheduler::Retry(const response &r, unsigned int attempt, chrono::milliseconds &wait) {
+	static thread_local minstd_rand jitter(chrono::steady_clock::now().time_since_epoch().count());
+	if (attempt >= retries || !Transient(r)) { return false; }
+	chrono::milliseconds full = backoff * (1 << attempt);
+	wait = full / 2 + chrono::milliseconds(jitter() % (full.count() / 2 + 1));
+	return true;
+}
+
+size_t datapoint::scheduler::Waiting() {
+	lock_guard<mutex> guard(bucket_lock);
+	size_t total = 0;
+	for (const vector<unsigned long> &queue : waiting) { total += queue.size(); }
+	return total;
+}
+
+shared_ptr<const datapoint::scheduler::response> datapoint::scheduler::Fetch(const string &key, priority p, fetcher fetch, bool *coalesced) {
+	promise<shared_ptr<const response> > result;
+	shared_future<shared_ptr<const response> > flight;
+	{
+		lock_guard<mutex> guard(flights_lock);
+		unordered_map<string, shared_future<shared_ptr<const response> > >::iterator itr = flights.find(key);
+		if (itr != flights.end()) {
+			flight = itr->second;
+		} else {
+			flights.emplace(key, result.get_future().share());
+		}
+	}
+	if (coalesced) { *coalesced = flight.valid(); }
+	if (flight.valid()) {
+		return flight.get();
+	}
+
+	/*
+	 * First caller for this key, so it does the work. The flight is removed before the result is published, so
+	 * anyone arriving after that starts a fresh request rather than picking up an old response.
+	 */
+	shared_ptr<const response> got;
+	exception_ptr failed;
+	try {
+		got = make_shared<const response>(Fetch(p, fetch));
+	} catch (...) {
+		failed = current_exception();
+	}
+	{
+		lock_guard<mutex> guard(flights_lock);
+		flights.erase(key);
+	}
+	(failed) ? result.set_exception(failed) : result.set_value(got);
+	if (failed) { rethrow_exception(failed); }
+	return got;
+}
+
+datapoint::scheduler::response datapoint::scheduler::Fetch(priority p, fetcher fetch) {
+	for (unsigned int attempt = 0; ; attempt++) {
+		Acquire(p);
+		response got = fetch(attempt);
+		chrono::milliseconds wait;
+		if (!Retry(got, attempt, wait)) { return got; }
+		this_thread::sleep_for(wait);
+	}
+}
+
+bool datapoint::scheduler::Transient(const response &r) {
+	if (!r.repeatable) { return false; }
+	switch (r.code) {
+		case CURLE_OK:
+			return r.status == 429 || r.status == 500 || r.status == 502 || r.status == 503 || r.status == 504;
+		case CURLE_COULDNT_RESOLVE_HOST:
+		case CURLE_COULDNT_CONNECT:
+		case CURLE_OPERATION_TIMEDOUT:
+		case CURLE_SEND_ERROR:
+		case CURLE_RECV_ERROR:
+		case CURLE_GOT_NOTHING:
+		case CURLE_PARTIAL_FILE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+datapoint::scheduler::priority datapoint::scheduler::Priority(const string &func, bool isForecast) {
+	if (func.compare(0, 8, "sitelist") == 0 || func.compare(0, 3, "all") == 0) { return BULK; }
+	return (isForecast) ? NORMAL : HIGH; //Observations go stale hourly, so they jump the queue
+}
+
+shared_ptr<datapoint::scheduler> datapoint::scheduler::Shared() {
+	static shared_ptr<scheduler> shared = make_shared<scheduler>();
+	return shared;
+}
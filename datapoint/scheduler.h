@@ -0,0 +1,90 @@
+/*
+ * DataPoint for C++
+ *
+ * Request scheduler, shared by every api object in the process by default. It sits in front of the network and
+ * does three things:
+ *   - Identical requests already in flight are coalesced, so later callers wait for the first one's response
+ *     rather than asking Datapoint again.
+ *   - A token bucket keeps the process inside Datapoint's fair use limits. Callers short of a token queue by
+ *     priority, observations first and bulk/sitelist requests last.
+ *   - Transient failures (timeouts, refused connections, 429 and 5xx) are retried with exponential backoff.
+ *
+ * api's DOM calls get all three. The async engine does the same with TryAcquire and Retry, and coalesces among
+ * its own requests, as it can't block. Streamed and workspace calls are rate limited and retried but never
+ * coalesced: their response goes straight into the caller's handler or buffer, so there's nothing to share.
+ *
+ */
+
+#ifndef DATAPOINT_SCHEDULER_H_
+#define DATAPOINT_SCHEDULER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "cache.h"
+
+#define SCHEDULER_PER_MINUTE 100 //Datapoint's fair use limit is 100 calls a minute (and 5000 a day)
+#define SCHEDULER_BURST 20 //Tokens a quiet bucket can save up
+#define SCHEDULER_RETRIES 2 //On top of the first attempt
+#define SCHEDULER_BACKOFF_MS 500 //Before the first retry, doubling each time after, with jitter
+
+namespace datapoint {
+		class scheduler {
+			public:
+				enum priority : uint8_t { HIGH, NORMAL, BULK, PRIORITIES };
+				class response {
+					public:
+						CURLcode code = CURLE_OK;
+						long status = 0;
+						std::string body;
+						cacheentry headers; //ETag and Last-Modified
+						bool repeatable = true; //False once a fetch can't be run again, e.g. a handler has records
+				} ;
+				typedef std::function<response(unsigned int attempt)> fetcher; //attempt is 0 the first time
+			private:
+				std::mutex bucket_lock;
+				std::condition_variable bucket_ready;
+				double rate; //Tokens per second, 0 for no limit
+				double burst;
+				double tokens;
+				std::chrono::steady_clock::time_point refilled;
+				std::vector<unsigned long> waiting[PRIORITIES]; //Tickets, first come first served. Short, and keeps its capacity.
+				unsigned long tickets = 0;
+				unsigned int retries;
+				std::chrono::milliseconds backoff;
+				std::mutex flights_lock;
+				std::unordered_map<std::string, std::shared_future<std::shared_ptr<const response> > > flights;
+				void Refill(std::chrono::steady_clock::time_point now);
+				bool First(unsigned long ticket) const;
+			public:
+				scheduler(double perMinute = SCHEDULER_PER_MINUTE, unsigned int inburst = SCHEDULER_BURST,
+						unsigned int inretries = SCHEDULER_RETRIES, unsigned int backoffMs = SCHEDULER_BACKOFF_MS);
+				scheduler(const scheduler &) = delete;
+				scheduler & operator=(const scheduler &) = delete;
+				void Acquire(priority p); //Blocks until a token is free and nothing more important is waiting
+				bool TryAcquire(priority p, std::chrono::steady_clock::duration &wait); //Doesn't block. On false, wait is when to try again.
+				bool Retry(const response &r, unsigned int attempt, std::chrono::milliseconds &wait); //Backoff before the next attempt, if any
+				/*
+				 * Runs fetch unless a request with the same key is already in flight, in which case that one's response
+				 * is shared and 'coalesced' is set. Each attempt, retries included, costs a token.
+				 */
+				std::shared_ptr<const response> Fetch(const std::string &key, priority p, fetcher fetch, bool *coalesced = nullptr);
+				response Fetch(priority p, fetcher fetch); //Tokens and retries alone, for responses that can't be shared
+				size_t Waiting();
+				static bool Transient(const response &r);
+				static priority Priority(const std::string &func, bool isForecast);
+				static std::shared_ptr<scheduler> Shared();
+		} ;//scheduler
+} //datapoint
+
+#endif /* DATAPOINT_SCHEDULER_H_ */
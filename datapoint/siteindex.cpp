@@ -0,0 +1,249 @@
+/*
+ * DataPoint for C++
+ *
+ * Spatial index over a DataPoint sitelist, see siteindex.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/siteindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+#define SITEINDEX_MAGIC "DPSI"
+#define SITEINDEX_VERSION 1
+#define EARTH_RADIUS 6371 //Kilometres
+
+datapoint::siteindex::point datapoint::siteindex::ToPoint(double lat, double lon) {
+	double toRadians = M_PI / 180;
+	point p;
+	p.x = cos(lat * toRadians) * cos(lon * toRadians);
+	p.y = cos(lat * toRadians) * sin(lon * toRadians);
+	p.z = sin(lat * toRadians);
+	return p;
+}
+
+static float Axis(float x, float y, float z, unsigned short int depth) {
+	switch (depth % 3) {
+		case 0: return x;
+		case 1: return y;
+		default: return z;
+	}
+}
+
+bool datapoint::siteindex::Build(const rapidjson::Document &json) {
+	if (!json.IsObject() || !json.HasMember("Locations") || !json["Locations"].HasMember("Location")) {
+		return false;
+	}
+	const rapidjson::Value& locations = json["Locations"]["Location"];
+	if (!locations.IsArray()) {
+		return false;
+	}
+	vector<site> list;
+	list.reserve(locations.Size());
+	for (rapidjson::Value::ConstValueIterator itr = locations.Begin(); itr != locations.End(); ++itr) {
+		if ( !(*itr).HasMember("id") || !(*itr).HasMember("latitude") || !(*itr).HasMember("longitude") ) {
+			continue; //Can't place it, so skip it rather than guessing.
+		}
+		site s;
+		s.id = std::stoul( (*itr)["id"].GetString() );
+		s.lat = std::stof( (*itr)["latitude"].GetString() );
+		s.lon = std::stof( (*itr)["longitude"].GetString() );
+		( (*itr).HasMember("name") ) ? s.name = (*itr)["name"].GetString() : s.name = "" ;
+		( (*itr).HasMember("unitaryAuthArea") ) ? s.area = (*itr)["unitaryAuthArea"].GetString() : s.area = "" ;
+		list.push_back(std::move(s));
+	}
+	return Build(std::move(list));
+}
+
+bool datapoint::siteindex::Build(vector<site> list) {
+	vector<point> unordered;
+	unordered.reserve(list.size());
+	for (const site &s : list) {
+		unordered.push_back(ToPoint(s.lat, s.lon));
+	}
+
+	/*
+	 * Sort an index rather than the sites themselves, then move everything into tree order in one go.
+	 */
+	points.swap(unordered);
+	vector<size_t> order(list.size());
+	for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+	Place(order, 0, order.size(), 0);
+
+	sites.clear(); sites.reserve(list.size());
+	unordered.clear(); unordered.reserve(list.size());
+	for (size_t i : order) {
+		sites.push_back(std::move(list[i]));
+		unordered.push_back(points[i]);
+	}
+	points.swap(unordered);
+
+	Finish();
+	return !sites.empty();
+}
+
+void datapoint::siteindex::Place(vector<size_t> &order, size_t lo, size_t hi, unsigned short int depth) const {
+	if (hi - lo < 2) { return; }
+	size_t mid = lo + (hi - lo) / 2;
+	nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi, [&](size_t a, size_t b) {
+		return Axis(points[a].x, points[a].y, points[a].z, depth) < Axis(points[b].x, points[b].y, points[b].z, depth);
+	});
+	Place(order, lo, mid, depth + 1);
+	Place(order, mid + 1, hi, depth + 1);
+}
+
+void datapoint::siteindex::Finish() {
+	ids.clear();
+	ids.reserve(sites.size());
+	for (size_t i = 0; i < sites.size(); i++) {
+		ids.push_back(make_pair(sites[i].id, i));
+	}
+	sort(ids.begin(), ids.end());
+}
+
+void datapoint::siteindex::Search(size_t lo, size_t hi, unsigned short int depth, const point &target, size_t k,
+		vector<pair<float, size_t> > &best) const {
+	if (lo >= hi) { return; }
+	size_t mid = lo + (hi - lo) / 2;
+	const point &p = points[mid];
+
+	float dx = p.x - target.x, dy = p.y - target.y, dz = p.z - target.z;
+	float dist = dx * dx + dy * dy + dz * dz;
+	if (best.size() < k) {
+		best.push_back(make_pair(dist, mid));
+		push_heap(best.begin(), best.end());
+	} else if (dist < best.front().first) {
+		pop_heap(best.begin(), best.end());
+		best.back() = make_pair(dist, mid);
+		push_heap(best.begin(), best.end());
+	}
+
+	float delta = Axis(target.x, target.y, target.z, depth) - Axis(p.x, p.y, p.z, depth);
+	//Closer half first, then the far half only if the splitting plane is nearer than our worst match.
+	if (delta < 0) {
+		Search(lo, mid, depth + 1, target, k, best);
+		if (best.size() < k || delta * delta < best.front().first) { Search(mid + 1, hi, depth + 1, target, k, best); }
+	} else {
+		Search(mid + 1, hi, depth + 1, target, k, best);
+		if (best.size() < k || delta * delta < best.front().first) { Search(lo, mid, depth + 1, target, k, best); }
+	}
+}
+
+const datapoint::site * datapoint::siteindex::Nearest(double lat, double lon) const {
+	vector<const site *> found = Nearest(lat, lon, 1);
+	return (found.empty()) ? nullptr : found[0];
+}
+
+vector<const datapoint::site *> datapoint::siteindex::Nearest(double lat, double lon, size_t k) const {
+	vector<const site *> found;
+	if (k == 0 || sites.empty()) { return found; }
+	vector<pair<float, size_t> > best;
+	best.reserve(k + 1);
+	Search(0, sites.size(), 0, ToPoint(lat, lon), k, best);
+	sort_heap(best.begin(), best.end()); //Nearest first
+	found.reserve(best.size());
+	for (const pair<float, size_t> &b : best) {
+		found.push_back(&sites[b.second]);
+	}
+	return found;
+}
+
+const datapoint::site * datapoint::siteindex::Find(unsigned int id) const {
+	vector<pair<unsigned int, size_t> >::const_iterator itr = lower_bound(ids.begin(), ids.end(), make_pair(id, (size_t)0));
+	if (itr == ids.end() || itr->first != id) { return nullptr; }
+	return &sites[itr->second];
+}
+
+double datapoint::siteindex::Kilometres(const site &from, double lat, double lon) {
+	//Haversine, in radians this time.
+	double toRadians = M_PI / 180;
+	double dlat = (lat - from.lat) * toRadians;
+	double dlon = (lon - from.lon) * toRadians;
+	double ans = pow(sin(dlat / 2), 2) + cos(from.lat * toRadians) * cos(lat * toRadians) * pow(sin(dlon / 2), 2);
+	return 2 * asin(sqrt(ans)) * EARTH_RADIUS;
+}
+
+/*
+ * File layout, all little endian as written by the host:
+ *   "DPSI" | uint32 version | uint32 count | count * { uint32 id | float lat | float lon | uint16 len | name | uint16 len | area }
+ * Sites are written in tree order, so loading is a straight read with no rebuild.
+ */
+static void WriteString(ofstream &out, const string &str) {
+	uint16_t len = (str.size() > UINT16_MAX) ? UINT16_MAX : str.size();
+	out.write((const char*)&len, sizeof(len));
+	out.write(str.data(), len);
+}
+
+static bool ReadString(ifstream &in, string &str) {
+	uint16_t len = 0;
+	if (!in.read((char*)&len, sizeof(len))) { return false; }
+	str.resize(len);
+	return (len == 0) || (bool)in.read(&str[0], len);
+}
+
+bool datapoint::siteindex::Save(string path) const {
+	ofstream out(path, ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!out) { return false; }
+	uint32_t version = SITEINDEX_VERSION, count = sites.size();
+	out.write(SITEINDEX_MAGIC, 4);
+	out.write((const char*)&version, sizeof(version));
+	out.write((const char*)&count, sizeof(count));
+	for (const site &s : sites) {
+		uint32_t id = s.id;
+		out.write((const char*)&id, sizeof(id));
+		out.write((const char*)&s.lat, sizeof(s.lat));
+		out.write((const char*)&s.lon, sizeof(s.lon));
+		WriteString(out, s.name);
+		WriteString(out, s.area);
+	}
+	return (bool)out;
+}
+
+bool datapoint::siteindex::Load(string path) {
+	ifstream in(path, ios_base::in | ios_base::binary);
+	if (!in) { return false; }
+	char magic[4];
+	uint32_t version = 0, count = 0;
+	if (!in.read(magic, 4) || memcmp(magic, SITEINDEX_MAGIC, 4) != 0) { return false; }
+	if (!in.read((char*)&version, sizeof(version)) || version != SITEINDEX_VERSION) { return false; }
+	if (!in.read((char*)&count, sizeof(count)) || count == 0) { return false; } //Empty is no use, keep what we had
+
+	/*
+	 * Every site takes at least its id, coordinates and two string lengths, so a count the rest of the file can't
+	 * hold is corrupt, and is never allocated.
+	 */
+	const uint64_t smallest = sizeof(uint32_t) + 2 * sizeof(float) + 2 * sizeof(uint16_t);
+	streampos here = in.tellg();
+	in.seekg(0, ios_base::end);
+	streampos end = in.tellg();
+	if (here < 0 || end < here || (uint64_t)count * smallest > (uint64_t)(end - here)) { return false; }
+	in.seekg(here);
+
+	vector<site> list(count);
+	for (site &s : list) {
+		uint32_t id = 0;
+		if (!in.read((char*)&id, sizeof(id)) || !in.read((char*)&s.lat, sizeof(s.lat)) || !in.read((char*)&s.lon, sizeof(s.lon))
+				|| !ReadString(in, s.name) || !ReadString(in, s.area)) {
+			return false; //Truncated, leave whatever we had before alone.
+		}
+		s.id = id;
+	}
+
+	sites.swap(list);
+	points.clear();
+	points.reserve(sites.size());
+	for (const site &s : sites) {
+		points.push_back(ToPoint(s.lat, s.lon));
+	}
+	Finish();
+	return !sites.empty();
+}
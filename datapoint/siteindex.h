@@ -0,0 +1,64 @@
+/*
+ * DataPoint for C++
+ *
+ * Spatial index over a DataPoint sitelist. Built once from a 'sitelist' response (forecast or observation),
+ * it keeps the coordinates as numbers and answers nearest and k-nearest site queries without scanning
+ * every location. It can be saved to disk so a later process can skip the sitelist call altogether.
+ *
+ */
+
+#ifndef DATAPOINT_SITEINDEX_H_
+#define DATAPOINT_SITEINDEX_H_
+
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+namespace datapoint {
+		class site {
+			public:
+				unsigned int id = 0;
+				std::string name;
+				std::string area; //unitaryAuthArea, empty if Datapoint didn't supply one
+				float lat = 0; //Degrees
+				float lon = 0; //Degrees
+		} ;//site
+		class siteindex {
+			/*
+			 * A static, balanced k-d tree stored implicitly in the sites array: the node for any range [lo, hi)
+			 * is at the middle, split on axis depth % 3. Sites are placed on the unit sphere (x, y, z) so a plain
+			 * Euclidean search gives the same ordering as great circle distance, and there's no wrap at 180.
+			 *
+			 * Once built the index is never modified, so a single instance can be shared between api objects
+			 * and threads.
+			 */
+			private:
+				class point {
+					public:
+						float x, y, z;
+				} ;
+				std::vector<site> sites; //Tree order
+				std::vector<point> points; //Same order as sites
+				std::vector<std::pair<unsigned int, size_t> > ids; //Sorted by id, for Find()
+				void Place(std::vector<size_t> &order, size_t lo, size_t hi, unsigned short int depth) const;
+				void Search(size_t lo, size_t hi, unsigned short int depth, const point &target, size_t k,
+						std::vector<std::pair<float, size_t> > &best) const;
+				static point ToPoint(double lat, double lon);
+				void Finish();
+			public:
+				bool Build(const rapidjson::Document &json); //From a 'sitelist' response
+				bool Build(std::vector<site> list);
+				bool Save(std::string path) const;
+				bool Load(std::string path);
+				const site * Nearest(double lat, double lon) const;
+				std::vector<const site *> Nearest(double lat, double lon, size_t k) const;
+				const site * Find(unsigned int id) const;
+				static double Kilometres(const site &from, double lat, double lon);
+				size_t Size() const { return sites.size(); }
+				bool Empty() const { return sites.empty(); }
+				const site & operator[](size_t i) const { return sites[i]; }
+		} ;//siteindex
+} //datapoint
+
+#endif /* DATAPOINT_SITEINDEX_H_ */
@@ -0,0 +1,192 @@
+/*
+ * DataPoint for C++
+ *
+ * Streaming parse of Datapoint responses, see stream.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/stream.h"
+#include "../datapoint/datapoint.h"
+#include "../datapoint/fields.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+datapoint::curlstream::curlstream(CURL *handle) : connection(handle) {
+	buffer.reserve(CURL_MAX_WRITE_SIZE); //cURL never hands over more than this at once
+	curl_easy_setopt(connection, CURLOPT_WRITEFUNCTION, Write);
+	curl_easy_setopt(connection, CURLOPT_WRITEDATA, this);
+	multi = curl_multi_init();
+	curl_multi_add_handle(multi, connection);
+}
+
+datapoint::curlstream::~curlstream() {
+	curl_multi_remove_handle(multi, connection);
+	curl_multi_cleanup(multi);
+}
+
+size_t datapoint::curlstream::Write(void *ptr, size_t size, size_t nmemb, curlstream *stream) {
+	size_t numBytes = size * nmemb;
+	stream->buffer.append((char*)ptr, numBytes);
+	return numBytes;
+}
+
+bool datapoint::curlstream::Fill() {
+	buffer.clear();
+	pos = 0;
+	while (buffer.empty() && !done) {
+		int running = 0;
+		CURLMcode code = curl_multi_perform(multi, &running);
+		if (code != CURLM_OK) {
+			result = CURLE_RECV_ERROR;
+			done = true;
+			break;
+		}
+		int queued = 0;
+		while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+			if (msg->msg == CURLMSG_DONE) {
+				result = msg->data.result;
+				done = true;
+			}
+		}
+		if (buffer.empty() && !done) {
+			curl_multi_wait(multi, NULL, 0, 1000, NULL);
+		}
+	}
+	return !buffer.empty();
+}
+
+void datapoint::recordhandler::Restart() {
+	depth = 0;
+	recordDepth = -1;
+	pending = false;
+	for (bool &isArray : recordArray) { isArray = false; }
+	records = 0;
+}
+
+bool datapoint::recordhandler::Key(const Ch *str, rapidjson::SizeType length, bool) {
+	key.assign(str, length);
+	pending = (recordDepth < 0) && (key == recordKey);
+	return true;
+}
+
+bool datapoint::recordhandler::Value(const char *str, rapidjson::SizeType length) {
+	if (recordDepth >= 0 && depth == recordDepth) {
+		Field(key, str, length);
+	} else if (recordDepth < 0) {
+		Context(key, str, length);
+	}
+	pending = false;
+	return true;
+}
+
+bool datapoint::recordhandler::StartObject() {
+	if (depth + 1 >= STREAM_DEPTH_MAX) { return false; } //Not a Datapoint response, stop rather than overrun.
+	bool record = (recordDepth < 0) && (pending || recordArray[depth]);
+	depth++;
+	recordArray[depth] = false;
+	pending = false;
+	if (record) {
+		recordDepth = depth;
+		records++;
+		Begin();
+	}
+	return true;
+}
+
+bool datapoint::recordhandler::EndObject(rapidjson::SizeType) {
+	if (depth == recordDepth) {
+		End();
+		recordDepth = -1;
+	}
+	depth--;
+	return true;
+}
+
+bool datapoint::recordhandler::StartArray() {
+	if (depth + 1 >= STREAM_DEPTH_MAX) { return false; }
+	depth++;
+	recordArray[depth] = pending;
+	pending = false;
+	return true;
+}
+
+bool datapoint::recordhandler::EndArray(rapidjson::SizeType) {
+	recordArray[depth] = false;
+	depth--;
+	return true;
+}
+
+void datapoint::sitelisthandler::Begin() {
+	current = site();
+	placed = false;
+}
+
+void datapoint::sitelisthandler::Field(const string &key, const char *str, rapidjson::SizeType length) {
+	if (key == "id") { current.id = strtoul(str, NULL, 10); }
+	else if (key == "latitude") { current.lat = strtof(str, NULL); placed = true; }
+	else if (key == "longitude") { current.lon = strtof(str, NULL); }
+	else if (key == "name") { current.name.assign(str, length); }
+	else if (key == "unitaryAuthArea") { current.area.assign(str, length); }
+}
+
+void datapoint::sitelisthandler::End() {
+	if (placed && current.id != 0) { sites.push_back(std::move(current)); }
+}
+
+void datapoint::forecasthandler::Begin() {
+	forecasts->push_back(forecast());
+	forecasts->back().weatherType = 33;
+	forecasts->back().date = date;
+}
+
+void datapoint::forecasthandler::Field(const string &key, const char *str, rapidjson::SizeType length) {
+	forecast_fields.Set(forecasts->back(), key.data(), key.size(), str, length);
+}
+
+void datapoint::forecasthandler::Context(const string &key, const char *str, rapidjson::SizeType length) {
+	if (key == "value") { date.assign(str, length); } //Each Period's date comes before its Reps
+}
+
+void datapoint::observationhandler::Begin() {
+	*latest = observation();
+	latest->weatherType = 33;
+	found = true;
+}
+
+void datapoint::observationhandler::Field(const string &key, const char *str, rapidjson::SizeType length) {
+	observation_fields.Set(*latest, key.data(), key.size(), str, length);
+}
+
+void datapoint::observationhandler::End() {
+	if (latest->windGust == "") { latest->windGust = latest->windSpeed; } //Same as GetObservation, not gusty means same as speed
+}
+
+template <class Record> void datapoint::exporthandler<Record>::Begin() {
+	record = Record();
+}
+
+template <class Record> void datapoint::exporthandler<Record>::Field(const string &key, const char *str, rapidjson::SizeType length) {
+	record.Set(key.c_str(), str, length);
+}
+
+template <class Record> void datapoint::exporthandler<Record>::End() {
+	if (!dated) { return; } //Same as the DOM export, a Period without a date is skipped
+	out->Write(site, midnight + record.minsofday * 60, record);
+	rows++;
+}
+
+template <class Record> void datapoint::exporthandler<Record>::Context(const string &key, const char *str, rapidjson::SizeType length) {
+	if (key == "i") {
+		site = strtoul(str, NULL, 10);
+	} else if (key == "value") {
+		dated = ParseDate(str, length, midnight);
+	}
+}
+
+template class datapoint::exporthandler<datapoint::forecastrecord>;
+template class datapoint::exporthandler<datapoint::observationrecord>;
@@ -0,0 +1,163 @@
+/*
+ * DataPoint for C++
+ *
+ * Streaming parse of Datapoint responses. Rather than buffering the whole download and building a DOM, bytes
+ * are handed to a rapidjson::Reader as cURL receives them and SAX handlers fill forecast, observation and site
+ * records directly. Parsing overlaps the transfer and the only buffer held is the chunk cURL just delivered.
+ *
+ */
+
+#ifndef DATAPOINT_STREAM_H_
+#define DATAPOINT_STREAM_H_
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+#include <rapidjson/reader.h>
+
+#include "siteindex.h"
+
+#define STREAM_DEPTH_MAX 32 //Datapoint nests about six deep
+
+namespace datapoint {
+		class forecast;
+		class observation;
+		class exporter;
+		class curlstream {
+			/*
+			 * A rapidjson input stream that runs its own cURL transfer. When the parser runs out of bytes the
+			 * transfer is driven forward (through a private curl_multi, on the calling thread) until cURL hands
+			 * over the next chunk. cURL isn't asked for more until the parser has used up the last one.
+			 */
+			private:
+				CURLM *multi;
+				CURL *connection;
+				std::string buffer;
+				size_t pos = 0;
+				size_t total = 0;
+				bool done = false;
+				CURLcode result = CURLE_OK;
+				bool Fill();
+				static size_t Write(void *ptr, size_t size, size_t nmemb, curlstream *stream);
+			public:
+				typedef char Ch;
+				curlstream(CURL *handle); //URL and options already set. The handle is detached, not cleaned up.
+				~curlstream();
+				curlstream(const curlstream &) = delete;
+				curlstream & operator=(const curlstream &) = delete;
+				Ch Peek() { return (pos < buffer.size() || Fill()) ? buffer[pos] : '\0'; }
+				Ch Take() { return (pos < buffer.size() || Fill()) ? (total++, buffer[pos++]) : '\0'; }
+				size_t Tell() const { return total; }
+				CURLcode Result() const { return result; }
+				//Write side, required by rapidjson's stream concept but never used.
+				Ch * PutBegin() { return 0; }
+				void Put(Ch) {}
+				void Flush() {}
+				size_t PutEnd(Ch *) { return 0; }
+		} ;//curlstream
+		class recordhandler {
+			/*
+			 * Walks the SAX events and picks out "records", the objects that sit under a given key either directly
+			 * or as array elements. Datapoint flips between the two around midnight, so both are handled the same.
+			 * Every string (and number, parsed as a string) inside a record is passed to Field, and those outside
+			 * any record to Context.
+			 */
+			private:
+				const char *recordKey;
+				unsigned short int depth = 0;
+				int recordDepth = -1;
+				bool pending = false; //Last key seen was recordKey
+				bool recordArray[STREAM_DEPTH_MAX] = { false };
+				std::string key;
+				size_t records = 0; //Begun, so a failed transfer with none can be tried again
+				bool Value(const char *str, rapidjson::SizeType length);
+			protected:
+				virtual void Begin() = 0;
+				virtual void Field(const std::string &key, const char *str, rapidjson::SizeType length) = 0;
+				virtual void End() = 0;
+				virtual void Context(const std::string &, const char *, rapidjson::SizeType) {} //For what surrounds a record
+			public:
+				typedef char Ch;
+				recordhandler(const char *inRecordKey) : recordKey(inRecordKey) { key.reserve(32); }
+				virtual ~recordhandler() {}
+				size_t Records() const { return records; }
+				void Restart(); //Back to the top, for another go at a body that failed before any record
+				bool Null() { return Value("", 0); }
+				bool Bool(bool) { return Value("", 0); }
+				bool Int(int) { return Value("", 0); }
+				bool Uint(unsigned) { return Value("", 0); }
+				bool Int64(int64_t) { return Value("", 0); }
+				bool Uint64(uint64_t) { return Value("", 0); }
+				bool Double(double) { return Value("", 0); }
+				bool RawNumber(const Ch *str, rapidjson::SizeType length, bool) { return Value(str, length); }
+				bool String(const Ch *str, rapidjson::SizeType length, bool) { return Value(str, length); }
+				bool Key(const Ch *str, rapidjson::SizeType length, bool);
+				bool StartObject();
+				bool EndObject(rapidjson::SizeType);
+				bool StartArray();
+				bool EndArray(rapidjson::SizeType);
+		} ;//recordhandler
+		class sitelisthandler : public recordhandler {
+			private:
+				site current;
+				bool placed = false;
+			protected:
+				void Begin();
+				void Field(const std::string &key, const char *str, rapidjson::SizeType length);
+				void End();
+			public:
+				std::vector<site> sites;
+				sitelisthandler() : recordhandler("Location") {}
+		} ;//sitelisthandler
+		class forecasthandler : public recordhandler {
+			private:
+				std::string date; //Of the Period being read
+			protected:
+				void Begin();
+				void Field(const std::string &key, const char *str, rapidjson::SizeType length);
+				void End() {}
+				void Context(const std::string &key, const char *str, rapidjson::SizeType length);
+			public:
+				std::vector<forecast> *forecasts;
+				forecasthandler(std::vector<forecast> *out) : recordhandler("Rep"), forecasts(out) {}
+		} ;//forecasthandler
+		class observationhandler : public recordhandler {
+			/*
+			 * Only the latest observation is wanted, so each Rep overwrites the one before.
+			 */
+			protected:
+				void Begin();
+				void Field(const std::string &key, const char *str, rapidjson::SizeType length);
+				void End();
+			public:
+				observation *latest;
+				bool found = false;
+				observationhandler(observation *out) : recordhandler("Rep"), latest(out) {}
+		} ;//observationhandler
+		template <class Record> class exporthandler : public recordhandler {
+			/*
+			 * Each Rep is written to the exporter as soon as it's parsed, so rows leave while the rest of the
+			 * response is still downloading. Its site and day come from the Location's "i" and the Period's
+			 * "value", which Datapoint sends before the Reps they hold. For forecastrecord and observationrecord.
+			 */
+			private:
+				exporter *out;
+				Record record;
+				unsigned int site = 0;
+				time_t midnight = 0;
+				bool dated = false;
+			protected:
+				void Begin();
+				void Field(const std::string &key, const char *str, rapidjson::SizeType length);
+				void End();
+				void Context(const std::string &key, const char *str, rapidjson::SizeType length);
+			public:
+				size_t rows = 0;
+				exporthandler(exporter *into) : recordhandler("Rep"), out(into) {}
+		} ;//exporthandler
+} //datapoint
+
+#endif /* DATAPOINT_STREAM_H_ */
@@ -0,0 +1,251 @@
+/*
+ * DataPoint for C++
+ *
+ * Typed forecast and observation storage, see typed.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/typed.h"
+#include "../datapoint/datapoint.h"
+#include "../datapoint/fields.h"
+
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+/*
+ * std::from_chars doesn't allocate, doesn't care about locale and won't throw, unlike std::stoul and friends.
+ * The whole string has to be a number for the parse to count.
+ */
+template <class T> static bool FromChars(const char *str, size_t length, T &out) {
+	T value;
+	from_chars_result result = from_chars(str, str + length, value);
+	if (result.ec != errc() || result.ptr != str + length || length == 0) { return false; }
+	out = value;
+	return true;
+}
+
+template <class T> static bool FromCharsNarrow(const char *str, size_t length, T &out) {
+	long value;
+	if (!FromChars(str, length, value) || value < numeric_limits<T>::min() || value > numeric_limits<T>::max()) { return false; }
+	out = (T)value;
+	return true;
+}
+
+bool datapoint::ParseNumber(const char *str, size_t length, int8_t &out) { return FromCharsNarrow(str, length, out); }
+bool datapoint::ParseNumber(const char *str, size_t length, uint8_t &out) { return FromCharsNarrow(str, length, out); }
+bool datapoint::ParseNumber(const char *str, size_t length, uint16_t &out) { return FromCharsNarrow(str, length, out); }
+bool datapoint::ParseNumber(const char *str, size_t length, uint32_t &out) { return FromChars(str, length, out); }
+bool datapoint::ParseNumber(const char *str, size_t length, float &out) { return FromChars(str, length, out); }
+
+static const char *visibility_names[] = { "UN", "VP", "PO", "MO", "GO", "VG", "EX" };
+static const char *compass_names[] = { "N", "NNE", "NE", "ENE", "E", "ESE", "SE", "SSE", "S", "SSW", "SW", "WSW", "W", "WNW", "NW", "NNW" };
+static const char *tendency_names[] = { "F", "S", "R" };
+
+template <class T, size_t N> static bool FromName(const char *(&names)[N], const char *str, size_t length, T &out) {
+	for (size_t i = 0; i < N; i++) {
+		if (strlen(names[i]) == length && memcmp(names[i], str, length) == 0) {
+			out = (T)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool datapoint::ParseCode(const char *str, size_t length, visibilitycode &out) { return FromName(visibility_names, str, length, out); }
+bool datapoint::ParseCode(const char *str, size_t length, compass &out) { return FromName(compass_names, str, length, out); }
+bool datapoint::ParseCode(const char *str, size_t length, tendencycode &out) { return FromName(tendency_names, str, length, out); }
+const char * datapoint::CodeName(visibilitycode code) { return visibility_names[(size_t)code]; }
+const char * datapoint::CodeName(compass code) { return compass_names[(size_t)code]; }
+const char * datapoint::CodeName(tendencycode code) { return tendency_names[(size_t)code]; }
+
+/*
+ * Days since 1970-01-01 for a proleptic Gregorian date, so there's no need for timegm or the TZ environment.
+ */
+static long DaysFromCivil(long year, unsigned int month, unsigned int day) {
+	year -= (month <= 2);
+	long era = (year >= 0 ? year : year - 399) / 400;
+	unsigned int yoe = (unsigned int)(year - era * 400);
+	unsigned int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long)doe - 719468;
+}
+
+bool datapoint::ParseDate(const char *str, size_t length, time_t &out) {
+	uint16_t year;
+	uint8_t month, day;
+	if (length != 11 || str[4] != '-' || str[7] != '-' || str[10] != 'Z') { return false; }
+	if (!ParseNumber(str, 4, year) || !ParseNumber(str + 5, 2, month) || !ParseNumber(str + 8, 2, day)) { return false; }
+	if (month < 1 || month > 12 || day < 1 || day > 31) { return false; }
+	out = (time_t)DaysFromCivil(year, month, day) * 86400;
+	return true;
+}
+
+/*
+ * A field is only marked present when it parses, so a garbled value reads the same as a missing one.
+ */
+bool datapoint::forecastrecord::Set(const char *code, const char *str, size_t length) {
+	return forecastrecord_fields.Set(*this, code, strlen(code), str, length);
+}
+
+bool datapoint::observationrecord::Set(const char *code, const char *str, size_t length) {
+	return observationrecord_fields.Set(*this, code, strlen(code), str, length);
+}
+
+datapoint::forecastrecord datapoint::forecastrecord::From(const datapoint::forecast &frcst) {
+	forecastrecord record;
+	record.Set("F", frcst.feelsLike.data(), frcst.feelsLike.size());
+	record.Set("G", frcst.windGust.data(), frcst.windGust.size());
+	record.Set("H", frcst.humidity.data(), frcst.humidity.size());
+	record.Set("T", frcst.temperature.data(), frcst.temperature.size());
+	record.Set("V", frcst.visibility.data(), frcst.visibility.size());
+	record.Set("D", frcst.windDirection.data(), frcst.windDirection.size());
+	record.Set("S", frcst.windSpeed.data(), frcst.windSpeed.size());
+	record.Set("U", frcst.uv.data(), frcst.uv.size());
+	record.Set("Pp", frcst.precipitationProb.data(), frcst.precipitationProb.size());
+	record.Set("$", frcst.minsofday.data(), frcst.minsofday.size());
+	if (frcst.weatherType < 31) { //33 is what the string classes use for missing
+		record.weatherType = frcst.weatherType;
+		record.missing &= ~WEATHERTYPE;
+	}
+	return record;
+}
+
+datapoint::observationrecord datapoint::observationrecord::From(const datapoint::observation &obs) {
+	observationrecord record;
+	record.Set("G", obs.windGust.data(), obs.windGust.size());
+	record.Set("T", obs.temperature.data(), obs.temperature.size());
+	record.Set("V", obs.visibility.data(), obs.visibility.size());
+	record.Set("D", obs.windDirection.data(), obs.windDirection.size());
+	record.Set("S", obs.windSpeed.data(), obs.windSpeed.size());
+	record.Set("P", obs.pressure.data(), obs.pressure.size());
+	record.Set("Pt", obs.tendency.data(), obs.tendency.size());
+	record.Set("Dp", obs.dewPoint.data(), obs.dewPoint.size());
+	record.Set("H", obs.humidity.data(), obs.humidity.size());
+	if (obs.weatherType < 31) {
+		record.weatherType = obs.weatherType;
+		record.missing &= ~WEATHERTYPE;
+	}
+	return record;
+}
+
+void datapoint::forecastseries::clear() {
+	minsofday.clear(); feelsLike.clear(); temperature.clear(); windGust.clear(); windSpeed.clear(); humidity.clear();
+	precipitationProb.clear(); uv.clear(); weatherType.clear(); visibility.clear(); windDirection.clear(); missing.clear();
+}
+
+void datapoint::forecastseries::reserve(size_t n) {
+	minsofday.reserve(n); feelsLike.reserve(n); temperature.reserve(n); windGust.reserve(n); windSpeed.reserve(n); humidity.reserve(n);
+	precipitationProb.reserve(n); uv.reserve(n); weatherType.reserve(n); visibility.reserve(n); windDirection.reserve(n); missing.reserve(n);
+}
+
+void datapoint::forecastseries::push_back(const forecastrecord &record) {
+	minsofday.push_back(record.minsofday);
+	feelsLike.push_back(record.feelsLike);
+	temperature.push_back(record.temperature);
+	windGust.push_back(record.windGust);
+	windSpeed.push_back(record.windSpeed);
+	humidity.push_back(record.humidity);
+	precipitationProb.push_back(record.precipitationProb);
+	uv.push_back(record.uv);
+	weatherType.push_back(record.weatherType);
+	visibility.push_back(record.visibility);
+	windDirection.push_back(record.windDirection);
+	missing.push_back(record.missing);
+}
+
+datapoint::forecastrecord datapoint::forecastseries::operator[](size_t i) const {
+	forecastrecord record;
+	record.minsofday = minsofday[i];
+	record.feelsLike = feelsLike[i];
+	record.temperature = temperature[i];
+	record.windGust = windGust[i];
+	record.windSpeed = windSpeed[i];
+	record.humidity = humidity[i];
+	record.precipitationProb = precipitationProb[i];
+	record.uv = uv[i];
+	record.weatherType = weatherType[i];
+	record.visibility = visibility[i];
+	record.windDirection = windDirection[i];
+	record.missing = missing[i];
+	return record;
+}
+
+void datapoint::observationseries::clear() {
+	minsofday.clear(); temperature.clear(); dewPoint.clear(); humidity.clear(); visibility.clear(); pressure.clear();
+	windGust.clear(); windSpeed.clear(); weatherType.clear(); windDirection.clear(); tendency.clear(); missing.clear();
+}
+
+void datapoint::observationseries::reserve(size_t n) {
+	minsofday.reserve(n); temperature.reserve(n); dewPoint.reserve(n); humidity.reserve(n); visibility.reserve(n); pressure.reserve(n);
+	windGust.reserve(n); windSpeed.reserve(n); weatherType.reserve(n); windDirection.reserve(n); tendency.reserve(n); missing.reserve(n);
+}
+
+void datapoint::observationseries::push_back(const observationrecord &record) {
+	minsofday.push_back(record.minsofday);
+	temperature.push_back(record.temperature);
+	dewPoint.push_back(record.dewPoint);
+	humidity.push_back(record.humidity);
+	visibility.push_back(record.visibility);
+	pressure.push_back(record.pressure);
+	windGust.push_back(record.windGust);
+	windSpeed.push_back(record.windSpeed);
+	weatherType.push_back(record.weatherType);
+	windDirection.push_back(record.windDirection);
+	tendency.push_back(record.tendency);
+	missing.push_back(record.missing);
+}
+
+datapoint::observationrecord datapoint::observationseries::operator[](size_t i) const {
+	observationrecord record;
+	record.minsofday = minsofday[i];
+	record.temperature = temperature[i];
+	record.dewPoint = dewPoint[i];
+	record.humidity = humidity[i];
+	record.visibility = visibility[i];
+	record.pressure = pressure[i];
+	record.windGust = windGust[i];
+	record.windSpeed = windSpeed[i];
+	record.weatherType = weatherType[i];
+	record.windDirection = windDirection[i];
+	record.tendency = tendency[i];
+	record.missing = missing[i];
+	return record;
+}
+
+template <class Series> static void DecodeReps(const rapidjson::Value &json, Series &series) {
+	const rapidjson::Value& days = json["SiteRep"]["DV"]["Location"]["Period"];
+	const rapidjson::Value *d_begin = &days, *d_end = &days + 1; //Period is an object rather than array just before midnight
+	if (days.IsArray()) { d_begin = days.Begin(); d_end = days.End(); }
+	for (rapidjson::Value::ConstValueIterator d_itr = d_begin; d_itr != d_end ; ++d_itr ) {
+		const rapidjson::Value& hours = (*d_itr)["Rep"];
+		if (hours.IsArray()) {
+			for (rapidjson::Value::ConstValueIterator itr = hours.Begin() ; itr != hours.End()  ; ++itr ) {
+				series.Append(*itr);
+			}
+		} else {
+			series.Append(hours);
+		}
+	}
+}
+
+/*
+ * Straight from the DOM, one pass over each Rep's members and no strings copied.
+ */
+void datapoint::forecastseries::Append(const rapidjson::Value &rep) {
+	forecastrecord record;
+	forecastrecord_fields.Decode(record, rep);
+	push_back(record);
+}
+void datapoint::forecastseries::Decode(const rapidjson::Value &json) { DecodeReps(json, *this); }
+void datapoint::observationseries::Append(const rapidjson::Value &rep) {
+	observationrecord record;
+	observationrecord_fields.Decode(record, rep);
+	push_back(record);
+}
+void datapoint::observationseries::Decode(const rapidjson::Value &json) { DecodeReps(json, *this); }
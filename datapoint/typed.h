@@ -0,0 +1,135 @@
+/*
+ * DataPoint for C++
+ *
+ * Typed alternative to the string based forecast and observation classes. Numbers are fixed width, visibility,
+ * compass direction and pressure tendency are enum coded, and anything Datapoint didn't send is flagged in a
+ * 'missing' bitmask rather than left as an empty string.
+ *
+ * The series classes hold a whole site's time series as one array per field, so scanning say every temperature
+ * touches one small contiguous array. Once reserved, appending to a series doesn't allocate.
+ *
+ */
+
+#ifndef DATAPOINT_TYPED_H_
+#define DATAPOINT_TYPED_H_
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+namespace datapoint {
+		class forecast;
+		class observation;
+		enum class visibilitycode : uint8_t { UN, VP, PO, MO, GO, VG, EX }; //Unknown, Very poor .. Excellent
+		enum class compass : uint8_t { N, NNE, NE, ENE, E, ESE, SE, SSE, S, SSW, SW, WSW, W, WNW, NW, NNW };
+		enum class tendencycode : uint8_t { F, S, R }; //Falling, Steady, Rising
+		bool ParseNumber(const char *str, size_t length, int8_t &out);
+		bool ParseNumber(const char *str, size_t length, uint8_t &out);
+		bool ParseNumber(const char *str, size_t length, uint16_t &out);
+		bool ParseNumber(const char *str, size_t length, uint32_t &out);
+		bool ParseNumber(const char *str, size_t length, float &out);
+		bool ParseCode(const char *str, size_t length, visibilitycode &out);
+		bool ParseCode(const char *str, size_t length, compass &out);
+		bool ParseCode(const char *str, size_t length, tendencycode &out);
+		const char * CodeName(visibilitycode code);
+		const char * CodeName(compass code);
+		const char * CodeName(tendencycode code);
+		bool ParseDate(const char *str, size_t length, time_t &out); //A Period's "2019-03-07Z", as UTC midnight
+		class forecastrecord {
+			public:
+				enum field : uint16_t { //Bits of 'missing'
+					FEELSLIKE = 1 << 0, WINDGUST = 1 << 1, HUMIDITY = 1 << 2, TEMPERATURE = 1 << 3, VISIBILITY = 1 << 4,
+					WINDDIRECTION = 1 << 5, WINDSPEED = 1 << 6, UV = 1 << 7, WEATHERTYPE = 1 << 8, PRECIPITATION = 1 << 9,
+					ALL = (1 << 10) - 1
+				};
+				uint16_t minsofday = 0;
+				int8_t feelsLike = 0; //Celsius
+				int8_t temperature = 0; //Celsius
+				uint8_t windGust = 0; //Miles Per Hour
+				uint8_t windSpeed = 0; //Miles Per Hour
+				uint8_t humidity = 0; //Percent
+				uint8_t precipitationProb = 0; //Percent
+				uint8_t uv = 0;
+				uint8_t weatherType = 31; //Ref weather_codes, 'Unknown' when missing
+				visibilitycode visibility = visibilitycode::UN;
+				compass windDirection = compass::N;
+				uint16_t missing = ALL;
+				bool Has(field f) const { return !(missing & f); }
+				bool Set(const char *code, const char *str, size_t length); //One Datapoint parameter code, e.g. "T"
+				static forecastrecord From(const datapoint::forecast &frcst);
+		} ;//forecastrecord
+		class observationrecord {
+			public:
+				enum field : uint16_t {
+					WINDGUST = 1 << 0, TEMPERATURE = 1 << 1, VISIBILITY = 1 << 2, WINDDIRECTION = 1 << 3, WINDSPEED = 1 << 4,
+					WEATHERTYPE = 1 << 5, PRESSURE = 1 << 6, TENDENCY = 1 << 7, DEWPOINT = 1 << 8, HUMIDITY = 1 << 9,
+					ALL = (1 << 10) - 1
+				};
+				uint16_t minsofday = 0;
+				float temperature = 0; //Celsius
+				float dewPoint = 0; //Celsius
+				float humidity = 0; //Percent
+				uint32_t visibility = 0; //Meters
+				uint16_t pressure = 0; //Hectopascal (hpa)
+				uint8_t windGust = 0; //Miles Per Hour
+				uint8_t windSpeed = 0; //Miles Per Hour
+				uint8_t weatherType = 31;
+				compass windDirection = compass::N;
+				tendencycode tendency = tendencycode::S;
+				uint16_t missing = ALL;
+				bool Has(field f) const { return !(missing & f); }
+				bool Set(const char *code, const char *str, size_t length);
+				static observationrecord From(const datapoint::observation &obs);
+		} ;//observationrecord
+		class forecastseries {
+			/*
+			 * One vector per field, all the same length. operator[] puts a record back together when that's handier.
+			 */
+			public:
+				std::vector<uint16_t> minsofday;
+				std::vector<int8_t> feelsLike;
+				std::vector<int8_t> temperature;
+				std::vector<uint8_t> windGust;
+				std::vector<uint8_t> windSpeed;
+				std::vector<uint8_t> humidity;
+				std::vector<uint8_t> precipitationProb;
+				std::vector<uint8_t> uv;
+				std::vector<uint8_t> weatherType;
+				std::vector<visibilitycode> visibility;
+				std::vector<compass> windDirection;
+				std::vector<uint16_t> missing;
+				size_t size() const { return minsofday.size(); }
+				void clear();
+				void reserve(size_t n);
+				void push_back(const forecastrecord &record);
+				forecastrecord operator[](size_t i) const;
+				void Decode(const rapidjson::Value &json); //Appends every Rep of a 3hourly response
+				void Append(const rapidjson::Value &rep);
+		} ;//forecastseries
+		class observationseries {
+			public:
+				std::vector<uint16_t> minsofday;
+				std::vector<float> temperature;
+				std::vector<float> dewPoint;
+				std::vector<float> humidity;
+				std::vector<uint32_t> visibility;
+				std::vector<uint16_t> pressure;
+				std::vector<uint8_t> windGust;
+				std::vector<uint8_t> windSpeed;
+				std::vector<uint8_t> weatherType;
+				std::vector<compass> windDirection;
+				std::vector<tendencycode> tendency;
+				std::vector<uint16_t> missing;
+				size_t size() const { return minsofday.size(); }
+				void clear();
+				void reserve(size_t n);
+				void push_back(const observationrecord &record);
+				observationrecord operator[](size_t i) const;
+				void Decode(const rapidjson::Value &json); //Appends every Rep of an hourly response, oldest first
+				void Append(const rapidjson::Value &rep);
+		} ;//observationseries
+} //datapoint
+
+#endif /* DATAPOINT_TYPED_H_ */
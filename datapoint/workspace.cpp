@@ -0,0 +1,62 @@
+/*
+ * DataPoint for C++
+ *
+ * Reusable call buffers, see workspace.h.
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include "../datapoint/workspace.h"
+
+#include <charconv>
+
+using namespace std;
+
+datapoint::workspace::workspace() : arena(WORKSPACE_ARENA), stack_arena(WORKSPACE_STACK) {
+	url.reserve(256);
+	body.reserve(WORKSPACE_BODY);
+}
+
+datapoint::workspace::~workspace() {
+	Reset();
+}
+
+void datapoint::workspace::Reset() {
+	/*
+	 * An arena's capacity only goes past its buffer when it had to take chunks from the heap. Those are freed
+	 * with it, and the buffer is made big enough that the same response fits next time.
+	 */
+	size_t valuesNeeded = (values && values->Capacity() > arena.size()) ? values->Capacity() * 2 : 0;
+	size_t stackNeeded = (stack && stack->Capacity() > stack_arena.size()) ? stack->Capacity() * 2 : 0;
+	json.reset(); //Before the allocators it lives in
+	values.reset();
+	stack.reset();
+	if (valuesNeeded) { arena.resize(valuesNeeded); }
+	if (stackNeeded) { stack_arena.resize(stackNeeded); }
+}
+
+void datapoint::workspace::Url(const string &base, const char *path, unsigned int id, const char *query, const string &key) {
+	/*
+	 * The same URL Call builds, appended piece by piece into a string that's already big enough.
+	 */
+	char digits[16];
+	to_chars_result end = to_chars(digits, digits + sizeof(digits), id);
+	url.assign(base);
+	url.append(path);
+	url.push_back('/');
+	url.append(digits, end.ptr);
+	url.append(query);
+	url.append("&key=");
+	url.append(key);
+}
+
+const rapidjson::Value * datapoint::workspace::Parse() {
+	Reset();
+	values.emplace(arena.data(), arena.size());
+	stack.emplace(stack_arena.data(), stack_arena.size());
+	json.emplace(&*values, WORKSPACE_STACK / 2, &*stack);
+	if (json->Parse(body.c_str(), body.size()).HasParseError()) { return nullptr; }
+	return &*json;
+}
@@ -0,0 +1,53 @@
+/*
+ * DataPoint for C++
+ *
+ * Buffers an api object keeps between calls, for long running loops that refresh the same sites over and over.
+ * The URL and response body are built in strings that keep their capacity, and the response is parsed into a
+ * rapidjson arena (a MemoryPoolAllocator over a buffer owned here) that's reset rather than freed. If a response
+ * outgrows the arena it spills to the heap once, and the arena is grown to fit next time, so after the first few
+ * calls nothing is allocated at all.
+ *
+ * The parsed document is only valid until the next call that uses the same workspace.
+ *
+ */
+
+#ifndef DATAPOINT_WORKSPACE_H_
+#define DATAPOINT_WORKSPACE_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#define WORKSPACE_BODY 16384 //Bytes, a 3 hourly forecast for one site is a few kB
+#define WORKSPACE_ARENA 65536 //Bytes of parsed values
+#define WORKSPACE_STACK 4096 //Bytes of parser stack
+
+namespace datapoint {
+		/*
+		 * Both the values and the parser's own stack come from arenas, so parsing never touches the heap.
+		 */
+		typedef rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<> > arenadocument;
+
+		class workspace {
+			private:
+				std::vector<char> arena;
+				std::vector<char> stack_arena;
+				std::optional<rapidjson::MemoryPoolAllocator<> > values;
+				std::optional<rapidjson::MemoryPoolAllocator<> > stack;
+				std::optional<arenadocument> json;
+				void Reset(); //Drops the last document, growing an arena it spilled out of
+			public:
+				std::string url;
+				std::string body;
+				workspace();
+				~workspace();
+				workspace(const workspace &) = delete;
+				workspace & operator=(const workspace &) = delete;
+				void Url(const std::string &base, const char *path, unsigned int id, const char *query, const std::string &key);
+				const rapidjson::Value * Parse(); //body, into the arena. nullptr if it isn't valid JSON.
+		} ;//workspace
+} //datapoint
+
+#endif /* DATAPOINT_WORKSPACE_H_ */
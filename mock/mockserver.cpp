@@ -0,0 +1,201 @@
+/*
+ * DataPoint for C++ (mock server)
+ *
+ * A stand-in for Datapoint that replays the recorded responses in bench/fixtures, for load testing and for
+ * trying out the client without an API key or network. It answers sitelist, forecast and observation requests for
+ * any site ID, any key, and adds whatever latency and errors it's asked to. HTTP/1.1 with keep-alive, one thread
+ * per connection.
+ *
+ * Build from the repository root, then point the client at it with Seturl or weather --url, e.g.
+ *   g++ -std=c++17 -O2 mock/mockserver.cpp -pthread -o datapoint-mock
+ *   ./datapoint-mock --port 8080 --latency 40 --jitter 20 --errors 0.01
+ *   ./weather --url http://127.0.0.1:8080/public/data/val --load 10000 --concurrency 32
+ *
+ * MIT License
+ * Copyright (c) 2019 Alan Percy Childs
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define MOCK_PORT 8080
+#define MOCK_REQUEST_MAX 8192 //Bytes of request line and headers, Datapoint requests are a few hundred
+
+static string fixtures[5]; //In the order below
+static const char *names[] = {
+	"sitelist_forecast.json", "sitelist_observation.json", "forecast_3hourly.json", "forecast_daily.json",
+	"observation_hourly.json"
+};
+enum { SITELIST_FORECAST, SITELIST_OBSERVATION, FORECAST_3HOURLY, FORECAST_DAILY, OBSERVATION_HOURLY, UNKNOWN };
+
+static double latency = 0; //Milliseconds added before every response
+static double jitter = 0; //Up to this many more, uniformly
+static double errors = 0; //Fraction answered 503
+static double drops = 0; //Fraction whose connection is closed without an answer
+static atomic<unsigned long long> served(0), failed(0), dropped(0);
+static volatile sig_atomic_t stopping = 0;
+
+static int Route(const string &path) {
+	bool forecast = path.find("/wxfcs/") != string::npos, observation = path.find("/wxobs/") != string::npos;
+	if (path.find("/sitelist") != string::npos) {
+		return (forecast) ? SITELIST_FORECAST : (observation) ? SITELIST_OBSERVATION : UNKNOWN;
+	}
+	if (forecast) { return (path.find("res=daily") != string::npos) ? FORECAST_DAILY : FORECAST_3HOURLY; }
+	if (observation) { return OBSERVATION_HOURLY; }
+	return UNKNOWN;
+}
+
+static bool Send(int fd, const string &data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t wrote = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (wrote <= 0) { return false; }
+		sent += wrote;
+	}
+	return true;
+}
+
+static void Serve(int fd) {
+	/*
+	 * Requests on one connection one after another. The client never pipelines or sends a body with a GET.
+	 */
+	thread_local mt19937 random(random_device{}());
+	uniform_real_distribution<double> chance(0, 1);
+	string pending;
+	char buffer[4096];
+	while (!stopping) {
+		size_t end;
+		while ((end = pending.find("\r\n\r\n")) == string::npos) {
+			ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+			if (got <= 0 || pending.size() > MOCK_REQUEST_MAX) {
+				close(fd);
+				return;
+			}
+			pending.append(buffer, got);
+		}
+		string request = pending.substr(0, end);
+		pending.erase(0, end + 4);
+
+		istringstream line(request);
+		string method, path;
+		line >> method >> path;
+
+		if (latency > 0 || jitter > 0) {
+			this_thread::sleep_for(chrono::duration<double, milli>(latency + jitter * chance(random)));
+		}
+		if (drops > 0 && chance(random) < drops) {
+			dropped++;
+			close(fd);
+			return;
+		}
+
+		int route = Route(path);
+		string status = "200 OK", body;
+		if (errors > 0 && chance(random) < errors) {
+			status = "503 Service Unavailable";
+			failed++;
+		} else if (method != "GET" || route == UNKNOWN) {
+			status = "404 Not Found";
+			failed++;
+		} else {
+			body = fixtures[route];
+			served++;
+		}
+		string reply = "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nContent-Length: " + to_string(body.size())
+				+ "\r\nConnection: keep-alive\r\n\r\n" + body;
+		if (!Send(fd, reply)) {
+			close(fd);
+			return;
+		}
+	}
+	close(fd);
+}
+
+static void Stop(int) {
+	stopping = 1;
+}
+
+int main(int argc, char *argv[]) {
+	int port = MOCK_PORT;
+	string dir = "bench/fixtures";
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc && arg != "--help") {
+			cout << "Missing a value after \"" << arg << "\"\n";
+			return 1;
+		}
+		if (arg == "--port") { port = atoi(argv[++i]); }
+		else if (arg == "--fixtures") { dir = argv[++i]; }
+		else if (arg == "--latency") { latency = atof(argv[++i]); }
+		else if (arg == "--jitter") { jitter = atof(argv[++i]); }
+		else if (arg == "--errors") { errors = atof(argv[++i]); }
+		else if (arg == "--drops") { drops = atof(argv[++i]); }
+		else {
+			cout << "\nUsage: " << argv[0] << " [--port 8080] [--fixtures bench/fixtures] [--latency ms] [--jitter ms]"
+					" [--errors fraction] [--drops fraction]\n"
+					"\t--errors answers that fraction of requests 503, --drops closes the connection without answering.\n\n";
+			return 1;
+		}
+	}
+
+	for (int f = 0; f < UNKNOWN; f++) {
+		ifstream in(dir + "/" + names[f], ios_base::in | ios_base::binary);
+		if (!in) {
+			cout << "Missing fixture " << dir << "/" << names[f] << endl;
+			return 1;
+		}
+		ostringstream body;
+		body << in.rdbuf();
+		fixtures[f] = body.str();
+	}
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 512) != 0) {
+		cout << "Can't listen on 127.0.0.1:" << port << " (" << strerror(errno) << ")" << endl;
+		return 1;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = Stop; //No SA_RESTART, so accept returns and the totals get printed
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	cout << "Mock Datapoint on http://127.0.0.1:" << port << "/public/data/val, " << latency << "ms +" << jitter
+			<< "ms latency, " << errors * 100 << "% errors, " << drops * 100 << "% drops" << endl;
+	while (!stopping) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) { continue; }
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		thread(Serve, fd).detach();
+	}
+	close(listener);
+	cout << served << " served, " << failed << " errors, " << dropped << " dropped" << endl;
+	return 0;
+}
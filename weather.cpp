@@ -15,18 +15,125 @@
  */
 #define LAYOUT_SPACER "  |  "
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
 #include "datapoint/datapoint.h"
+#include "datapoint/local.h"
 
 using namespace std;
 
+static double Millis(unsigned long long micros) { return micros / 1000.0; }
+
+static int LoadTest(string key, string url, unsigned long requests, unsigned int concurrency, bool needforecast, bool needobservation) {
+	/*
+	 * Every worker thread has its own api object, but they share the sitelist indexes, one metrics object and a
+	 * scheduler without a rate limit, so it's the client and the server being measured rather than the fair use
+	 * budget. Each operation is a random UK location, looked up and fetched like a normal run. Point --url at the
+	 * mock server (mock/mockserver.cpp), not at Datapoint.
+	 */
+	shared_ptr<datapoint::metrics> stats = make_shared<datapoint::metrics>();
+	shared_ptr<datapoint::scheduler> unlimited = make_shared<datapoint::scheduler>(0);
+	datapoint::api primer;
+	primer.Setkey(key);
+	if (url != "") { primer.Seturl(url); }
+	primer.Setmetrics(stats);
+	primer.Setscheduler(unlimited);
+	shared_ptr<const datapoint::siteindex> forecast_sites, observation_sites;
+	try {
+		if (needforecast) { forecast_sites = primer.Getsites(true); }
+		if (needobservation) { observation_sites = primer.Getsites(false); }
+	} catch (...) {
+		cout << "Couldn't get the sitelists from " << primer.Seturl() << endl;
+		return 1;
+	}
+
+	atomic<unsigned long> next(0), failures(0);
+	vector<vector<unsigned long long> > latencies(concurrency);
+	vector<thread> workers;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (unsigned int t = 0; t < concurrency; t++) {
+		workers.emplace_back([&, t]() {
+			datapoint::api weather;
+			weather.Setkey(key);
+			if (url != "") { weather.Seturl(url); }
+			weather.Setmetrics(stats);
+			weather.Setscheduler(unlimited);
+			weather.Seterrors(nullptr); //Injected errors are counted below rather than printed over the report
+			if (forecast_sites) { weather.Setsites(forecast_sites, true); }
+			if (observation_sites) { weather.Setsites(observation_sites, false); }
+			mt19937 random(t); //Same locations every run
+			uniform_real_distribution<double> lat(49.9, 58.7), lon(-8.2, 1.8);
+			latencies[t].reserve(requests / concurrency + 1);
+			while (next++ < requests) {
+				chrono::steady_clock::time_point began = chrono::steady_clock::now();
+				try {
+					weather.Setlocation(lat(random), lon(random));
+					if (needobservation) { weather.GetObservation(); }
+					if (needforecast) { weather.GetForecasts(); }
+				} catch (...) {
+					failures++;
+				}
+				latencies[t].push_back(datapoint::metrics::Since(began));
+			}
+		});
+	}
+	for (thread &worker : workers) { worker.join(); }
+	double seconds = datapoint::metrics::Since(start) / 1e6;
+
+	vector<unsigned long long> all;
+	for (vector<unsigned long long> &l : latencies) { all.insert(all.end(), l.begin(), l.end()); }
+	sort(all.begin(), all.end());
+	if (all.empty()) { all.push_back(0); }
+	auto exact = [&all](double p) { return all[min(all.size() - 1, (size_t)(p * all.size()))]; };
+	unsigned long long made = 0;
+	for (int e = 0; e < datapoint::metrics::SITELISTS; e++) {
+		made += stats->Counters((datapoint::metrics::endpoint)e).requests;
+	}
+
+	cout << "*** Load Test ***" << endl;
+	cout << "Operations: " << requests << " (" << requests - failures << " ok, " << failures << " failed)" << LAYOUT_SPACER;
+	cout << "Threads: " << concurrency << LAYOUT_SPACER;
+	cout << "Time: " << seconds << "s" << endl;
+	cout << "Throughput: " << requests / seconds << " operations/s" << LAYOUT_SPACER;
+	cout << made / seconds << " requests/s" << endl;
+	cout << "Latency: p50 " << Millis(exact(0.50)) << "ms" << LAYOUT_SPACER << "p95 " << Millis(exact(0.95)) << "ms"
+			<< LAYOUT_SPACER << "p99 " << Millis(exact(0.99)) << "ms" << LAYOUT_SPACER << "max " << Millis(all.back()) << "ms" << endl;
+	cout << "" << endl;
+	for (int e = 0; e < datapoint::metrics::ENDPOINTS; e++) {
+		datapoint::metrics::endpoint where = (datapoint::metrics::endpoint)e;
+		datapoint::metrics::counters counted = stats->Counters(where);
+		if (counted.requests == 0) { continue; }
+		cout << "*** " << datapoint::metrics::Name(where) << " ***" << endl;
+		cout << "Requests: " << counted.requests << LAYOUT_SPACER << "Failed: " << counted.failed << LAYOUT_SPACER;
+		cout << "Retries: " << counted.retries << LAYOUT_SPACER << "Coalesced: " << counted.coalesced << LAYOUT_SPACER;
+		cout << "Received: " << counted.bytes / 1024 << "KiB" << endl;
+		for (int p = 0; p < datapoint::metrics::PHASES; p++) {
+			datapoint::metrics::timing timed = stats->Timing(where, (datapoint::metrics::phase)p);
+			if (timed.count == 0) { continue; }
+			cout << "  " << datapoint::metrics::Name((datapoint::metrics::phase)p) << ": p50 " << Millis(timed.Percentile(0.50))
+					<< "ms" << LAYOUT_SPACER << "p95 " << Millis(timed.Percentile(0.95)) << "ms" << LAYOUT_SPACER << "p99 "
+					<< Millis(timed.Percentile(0.99)) << "ms" << LAYOUT_SPACER << "mean " << Millis(timed.Mean()) << "ms" << endl;
+		}
+	}
+	cout << "(Phase percentiles are the top of a power of two bucket, so read them as \"under\".)" << endl;
+	return (failures == requests) ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
 	/*
 	 * For this example program, unsafely assuming the user inputs correctly formatted arguments.
 	 * Expect crashes if you get it wrong.
 	 */
     bool needforecast = false, needobservation = false, needhelp = false;
-    string key = "", lat = "", lon = "";
+    string key = "", lat = "", lon = "", url = "", exportformat = "", output = "", socketpath = "";
+    unsigned long load = 0;
+    unsigned int concurrency = 8;
 	   for(int i = 1; i < argc; i++) {
 	      if (string(argv[i]) == "--help") {
 	    	  needhelp = true;
@@ -46,6 +153,24 @@ int main(int argc, char *argv[]) {
 	      }  else if ( string(argv[i]) == "--lon" ) {
 	    	  i++; lon = argv[i];
 	    	  continue;
+	      }  else if ( string(argv[i]) == "--url" ) {
+	    	  i++; url = argv[i];
+	    	  continue;
+	      }  else if ( string(argv[i]) == "--socket" ) {
+	    	  i++; socketpath = argv[i];
+	    	  continue;
+	      }  else if ( string(argv[i]) == "--export" ) {
+	    	  i++; exportformat = argv[i];
+	    	  continue;
+	      }  else if ( string(argv[i]) == "--output" ) {
+	    	  i++; output = argv[i];
+	    	  continue;
+	      }  else if ( string(argv[i]) == "--load" ) {
+	    	  i++; load = stoul(argv[i]);
+	    	  continue;
+	      }  else if ( string(argv[i]) == "--concurrency" ) {
+	    	  i++; concurrency = max(1, stoi(argv[i]));
+	    	  continue;
 	      } else {
 	    	  cout << "Invalid Option \"" << string(argv[i]) << "\"\n";
 	    	  needhelp = true;
@@ -66,11 +191,53 @@ int main(int argc, char *argv[]) {
 			   "\t\tGet and print latest observation.\n"
 			   "\t--forecast\n"
 			   "\t\tGet and print latest forecasts.\n"
+			   "\t--url\n"
+			   "\t\tOptional: Datapoint base URL, up to and including /val. (--url http://127.0.0.1:8080/public/data/val) \n"
+			   "\t--socket\n"
+			   "\t\tOptional: Ask the shared daemon on this socket instead, no key needed. (--socket /tmp/datapoint.sock) \n"
+			   "\t\tSee daemon/datapointd.cpp. \n"
+			   "\t--export\n"
+			   "\t\tExport every site instead, as ndjson or csv, one row per forecast or observation. \n"
+			   "\t\t--observation and --forecast pick what's exported (both if neither, ndjson only). (--export csv) \n"
+			   "\t--output\n"
+			   "\t\tOptional: File to export to, rather than standard output. (--output forecasts.csv) \n"
+			   "\t--load\n"
+			   "\t\tLoad test instead: make this many random lookups and report throughput and latency by phase. \n"
+			   "\t\t--observation and --forecast pick the calls (both if neither), and --lat and --lon aren't needed. \n"
+			   "\t\tAim it at the mock server with --url, see mock/mockserver.cpp. (--load 10000) \n"
+			   "\t--concurrency\n"
+			   "\t\tOptional: Threads making requests during a load test, 8 by default. (--concurrency 32) \n"
 	           "\t--help\n"
 	   	   	   "\t\tPrint this help message.\n"
 			   "\n\n" ;
 	   exit(1);
-	} else if (key == "" || lat == "" || lon == "") {
+	} else if (exportformat != "") {
+		if (key == "" || (exportformat != "ndjson" && exportformat != "csv")) {
+			cerr << "\nAn export needs a Datapoint API Key, and a format of ndjson or csv.\nSee --help for full usage.\n\n";
+			exit(1);
+		}
+		if ((!needobservation) && (!needforecast)) { needobservation = needforecast = true; }
+		if (exportformat == "csv" && needobservation && needforecast) {
+			cerr << "\nA CSV export holds one kind of row, so choose either --observation or --forecast.\n\n";
+			exit(1);
+		}
+		datapoint::exporter out(stdout, (exportformat == "csv") ? datapoint::exporter::CSV : datapoint::exporter::NDJSON);
+		if (output != "" && !out.Open(output)) {
+			cerr << "\nCouldn't open \"" << output << "\" for the export.\n\n";
+			exit(1);
+		}
+		datapoint::api weather;
+		weather.Setkey(key);
+		if (url != "") { weather.Seturl(url); }
+		weather.Seterrors(&cerr); //Rows may be going to stdout
+		if (needforecast) { weather.ExportAllForecasts(out); }
+		if (needobservation) { weather.ExportAllObservations(out); }
+		if (output != "") { cout << out.Rows() << " rows written to " << output << endl; }
+		return 0;
+	} else if (load > 0) {
+		if ((!needobservation) && (!needforecast)) { needobservation = needforecast = true; }
+		return LoadTest((key == "") ? "load-test" : key, url, load, concurrency, needforecast, needobservation);
+	} else if ((key == "" && socketpath == "") || lat == "" || lon == "") {
 		cout << "\nYou must specify all - Datapoint API Key, your latitude, and your longitude.\nSee --help for full usage.\n\n";
 		exit(1);
 	} else if ((!needobservation) && (!needforecast)) {
@@ -78,14 +245,23 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	datapoint::api weather;
+	datapoint::api weather; //Also where the weather codes come from when the daemon is used
+	unique_ptr<datapoint::localclient> shared; //Only with --socket
+	bool useshared = socketpath != "";
 	weather.Setkey(key);
+	if (url != "") { weather.Seturl(url); }
 	weather.Setlocation(stof(lat),stof(lon));
+	if (useshared) {
+		shared.reset(new datapoint::localclient(socketpath));
+		shared->Setlocation(stof(lat),stof(lon));
+	}
 
 	if (needobservation) {
-		datapoint::observation observation = weather.GetObservation();
+		datapoint::observation observation = (useshared) ? shared->GetObservation() : weather.GetObservation();
+		string name = (useshared) ? shared->observation_name : weather.observation_name;
+		string area = (useshared) ? shared->observation_area : weather.observation_area;
 		cout << "*** Current Observation **" << endl;
-		cout << "Site Name: " << weather.observation_name; (weather.observation_area == "") ? cout << endl : cout << ", " << weather.observation_area  << endl;
+		cout << "Site Name: " << name; (area == "") ? cout << endl : cout << ", " << area  << endl;
 		cout << "Weather Type: " << weather.weather_codes[observation.weatherType] << LAYOUT_SPACER; //Array magic
 		cout << "Temperature: " << observation.temperature << "c" << endl;
 		cout << "Wind Speed: " << observation.windSpeed << "mph" << LAYOUT_SPACER;
@@ -100,25 +276,53 @@ int main(int argc, char *argv[]) {
 	}
 
 	if (needforecast) {
-		datapoint::forecast *forecast = weather.GetForecast();
+		time_t hours_req = 24; //Get the next 24 hours weather. Only these forecasts are decoded.
+		vector<datapoint::forecast> forecasts;
+		vector<unsigned short int> hours; //UTC, as Datapoint sends it
+		string name, area;
+		if (useshared) {
+			/*
+			 * The daemon sends every forecast with its date, so the same window is picked as GetForecastView's.
+			 */
+			vector<datapoint::forecast> all = shared->GetForecasts();
+			time_t now = time(nullptr);
+			for (const datapoint::forecast &frcst : all) {
+				time_t midnight;
+				if (!datapoint::ParseDate(frcst.date.data(), frcst.date.size(), midnight)) { continue; }
+				time_t when = midnight + atoi(frcst.minsofday.c_str()) * 60;
+				if (when + 10800 <= now || when >= now + hours_req * 3600) { continue; } //Over, or too far ahead
+				forecasts.push_back(frcst);
+				hours.push_back((when % 86400) / 3600);
+			}
+			name = shared->forecast_name;
+			area = shared->forecast_area;
+		} else {
+			datapoint::forecastview view = weather.GetForecastView();
+			datapoint::forecastrange window = view.Next(hours_req * 3600);
+			for (const datapoint::forecastslot &slot : window) {
+				forecasts.push_back(slot.Forecast());
+				hours.push_back((slot.time % 86400) / 3600);
+			}
+			name = weather.forecast_name;
+			area = weather.forecast_area;
+		}
 		cout << "*** 3 Hourly Weather Forecast ***" << endl;
-		cout << "Site Name: " << weather.forecast_name; (weather.forecast_area == "") ? cout << endl : cout << ", " << weather.forecast_area  << endl;
-		float hours_req = 24; //Get the next 24 hours weather
-		unsigned short int reqs = (hours_req / 3) + 0.5; //The GetForecast gets 28 even if we don't use it all here. Also this is a cheap ceil.
-		for ( unsigned short int i = 0 ; i < reqs ; i++  ) {
-			unsigned short int time = (stoi(forecast[i].minsofday) / 60);
+		cout << "Site Name: " << name; (area == "") ? cout << endl : cout << ", " << area  << endl;
+		for ( unsigned short int i = 0 ; i < forecasts.size() ; i++  ) {
+			const datapoint::forecast &forecast = forecasts[i];
+			unsigned short int time = hours[i];
 			if (i > 0 && time == 00) {cout << "Tomorrow " << endl ;}
 			cout << "Time: " << time << ":00" << endl;
-			cout << "Weather Type: " << weather.weather_codes[forecast[i].weatherType] << LAYOUT_SPACER;
-			cout << "Precipitation Probability: " << forecast[i].precipitationProb << "%" << endl;
-			cout << "Temperature: " << forecast[i].temperature << "c" << LAYOUT_SPACER;
-			cout << "Feels Like: " << forecast[i].feelsLike << "c" << endl;
-			cout << "Wind Speed: " << forecast[i].windSpeed << "mph" << LAYOUT_SPACER;
-			cout << "Wind Direction: " << forecast[i].windDirection << LAYOUT_SPACER;
-			cout << "Wind Gust: " << forecast[i].windGust << "mph" << endl;
-			cout << "Humidity: " << forecast[i].humidity << "%" << LAYOUT_SPACER;
-			cout << "Visibility: " << forecast[i].visibility << LAYOUT_SPACER;
-			cout << "UV Level: " << forecast[i].uv << endl;
+			cout << "Weather Type: " << weather.weather_codes[forecast.weatherType] << LAYOUT_SPACER;
+			cout << "Precipitation Probability: " << forecast.precipitationProb << "%" << endl;
+			cout << "Temperature: " << forecast.temperature << "c" << LAYOUT_SPACER;
+			cout << "Feels Like: " << forecast.feelsLike << "c" << endl;
+			cout << "Wind Speed: " << forecast.windSpeed << "mph" << LAYOUT_SPACER;
+			cout << "Wind Direction: " << forecast.windDirection << LAYOUT_SPACER;
+			cout << "Wind Gust: " << forecast.windGust << "mph" << endl;
+			cout << "Humidity: " << forecast.humidity << "%" << LAYOUT_SPACER;
+			cout << "Visibility: " << forecast.visibility << LAYOUT_SPACER;
+			cout << "UV Level: " << forecast.uv << endl;
 			cout << "" << endl;
 		}
 		cout << "" << endl;